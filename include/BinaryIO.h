@@ -0,0 +1,47 @@
+// Header file for reading and writing plain values and arrays of them as
+// raw bytes, in the byte order of the machine
+// only meant for files the same build reads back, e.g. PlanCache
+
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+template <typename T>
+void writeValue(std::ostream &out, const T &value) {
+  out.write((const char *)&value, sizeof(T));
+}
+
+// the count, then the elements
+template <typename T>
+void writeArray(std::ostream &out, const std::vector<T> &values) {
+  writeValue<uint64_t>(out, values.size());
+  out.write((const char *)values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::istream &in, T &value) {
+  return (bool)in.read((char *)&value, sizeof(T));
+}
+
+// fails rather than allocate for a count the rest of the stream cannot hold
+template <typename T>
+bool readArray(std::istream &in, std::vector<T> &values) {
+  uint64_t count;
+  if (!readValue(in, count)) return false;
+
+  const std::streampos at = in.tellg();
+  in.seekg(0, std::ios::end);
+  const std::streamoff left = in.tellg() - at;
+  in.seekg(at);
+
+  if (left < 0 || count > (uint64_t)left / sizeof(T)) return false;
+
+  values.resize(count);
+  return (bool)in.read((char *)values.data(), count * sizeof(T));
+}
+
+#endif
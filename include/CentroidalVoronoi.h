@@ -0,0 +1,36 @@
+// Header file for density weighted centroidal voronoi relaxation (Lloyd)
+// every iteration moves each point to the density weighted centroid of its
+// voronoi cell, until the points stop moving
+// the cells come from ShardedVoronoi (one sweep per strip of sites), and
+// their centroids are integrated over the density raster one site at a time,
+// in parallel
+
+#ifndef CENTROIDALVORONOI_H
+#define CENTROIDALVORONOI_H
+
+#include <vector>
+
+#include "glm/vec2.hpp" // glm::vec2
+#include "glm/gtx/transform.hpp"
+
+using glm::vec2;
+
+struct CVTParams {
+  int maxIterations;  // give up after this many
+  float tolerance;    // done once no point moves further than this, in pixels
+  int numThreads;     // 0 = one per core
+
+  CVTParams() : maxIterations(100), tolerance(0.01f), numThreads(0) {}
+};
+
+// relax 'points' inside [0, width] x [0, height] against 'density', a
+// width x height raster (row major, row = y) of non negative weights
+// points end up about density^(1/2) dense, so square the point density
+// you are after to get the weights
+// returns the number of iterations run
+int centroidalVoronoi(std::vector<vec2> &points,
+                      const std::vector<float> &density,
+                      const int width, const int height,
+                      const CVTParams &params = CVTParams());
+
+#endif
@@ -0,0 +1,68 @@
+// Header file for a dynamic forest over the stitch tree
+// every tree is kept as its euler tour in a treap, so linking two trees,
+// cutting an edge and asking whether two vertices are in the same tree
+// all take O(log n) expected time
+
+#ifndef EULERTOURFOREST_H
+#define EULERTOURFOREST_H
+
+#include <unordered_map>
+#include <vector>
+
+class EulerTourForest {
+private:
+        // treap nodes, kept in arrays and addressed by index (-1 = none)
+        // nodes 0 ... numVertices - 1 are the vertices themselves, every edge
+        // (u, v) adds two more, one for the arc u -> v and one for v -> u
+        std::vector<int> left, right, parent, count;
+        std::vector<unsigned int> priority;
+
+        // arc nodes of removed edges, reused by the next link
+        std::vector<int> freeNodes;
+
+        // node of the arc u -> v
+        std::unordered_map<long long, int> arcs;
+
+        int numVertices;
+        unsigned int seed;
+
+        int newNode();
+        void freeNode(int t);
+
+        int size(int t) const { return t == -1 ? 0 : count[t]; }
+        void update(int t);
+
+        // root of the treap holding 't', and the position of 't' in its tour
+        int root(int t) const;
+        int position(int t) const;
+
+        int merge(int a, int b);
+        // first 'k' nodes of 't' into 'a', the rest into 'b'
+        void split(int t, int k, int &a, int &b);
+
+        // rotate the tour of the tree holding 'v' so it starts at 'v'
+        void reroot(int v);
+
+        long long key(int u, int v) const {
+          return (long long)u * numVertices + v;
+        }
+
+public:
+        // 'numVertices' vertices 0 ... numVertices - 1 and no edges
+        EulerTourForest(const int numVertices);
+
+        // add edge (u, v), false if u and v are in the same tree already
+        bool link(const int u, const int v);
+
+        // remove edge (u, v), false if there is no such edge
+        bool cut(const int u, const int v);
+
+        // are u and v in the same tree?
+        bool connected(const int u, const int v) const {
+          return root(u) == root(v);
+        }
+
+        int size() const { return numVertices; }
+};
+
+#endif
@@ -3,7 +3,6 @@
 #include <memory>
 #include <SDL2/SDL.h>
 
-#include "DynamicColor.h"
 #include "Vector2D.h"
 #include "PixelRGB.h"
 
@@ -3,6 +3,11 @@
 
 #include <SDL2/SDL.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "PixelRGB.h"
 #include "Vector2D.h"
 
@@ -94,12 +99,23 @@ public:
 	 */
 	static void ComputeBarycentricCoordinates(const Vector2D& p, const Vector2D& a, const Vector2D& b, const Vector2D& c, float& u, float& v, float& w);
 
+	/*
+	 *	Cheap stand-in for Vector2D::Angle of (x, y): sorts directions the same way, starting
+	 *  at +x and turning towards +y, but ranges over [0, 4) instead of degrees and needs no trig.
+	 */
+	static float PseudoAngle(double x, double y);
+
 	/*
 	 *	Determines whether point P interesects with the triangle formed by a, b, and c,
 	 *	using point a as the origin. Algorithm is from: https://mathworld.wolfram.com/TriangleInterior.html
 	 */
 	static bool PointTriangleIntersection(const Vector2D& p, const Vector2D& aOrigin, const Vector2D& b, const Vector2D& c);
 
+	/*
+	 *	Same, also handing back the barycentric coordinates it had to compute anyway.
+	 */
+	static bool PointTriangleIntersection(const Vector2D& p, const Vector2D& aOrigin, const Vector2D& b, const Vector2D& c, float& u, float& v, float& w);
+
 	/*
 	 *	If val is greater than max or less than min, value returned
 	 *  returned is min or min respectively; effectively ensuring val
@@ -112,6 +128,36 @@ public:
 	 *  Pulled directly from here: https://stackoverflow.com/a/48291620
 	 */
 	static void SDL_DrawCircle(SDL_Renderer* renderer, int32_t centreX, int32_t centreY, int32_t radius);
+
+	/*
+	 *	Calls rowsFunc(rowBegin, rowEnd) over rows [0, numRows) in batches of batchSize,
+	 *  on numThreads threads (0 = one per core). The calling thread works too.
+	 */
+	template <typename RowsFunc>
+	static void ForEachRowBatch(int numRows, int batchSize, int numThreads, const RowsFunc& rowsFunc)
+	{
+		if (numThreads <= 0)
+			numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+		numThreads = std::min(numThreads, (numRows + batchSize - 1) / batchSize);
+
+		std::atomic<int> nextRow(0);
+
+		auto worker = [&]()
+		{
+			for (int row = nextRow.fetch_add(batchSize); row < numRows; row = nextRow.fetch_add(batchSize))
+				rowsFunc(row, std::min(row + batchSize, numRows));
+		};
+
+		std::vector<std::thread> pool;
+		for (int t = 1; t < numThreads; t++)
+			pool.push_back(std::thread(worker));
+
+		worker();
+
+		for (auto& t : pool)
+			t.join();
+	}
 	
 };
 
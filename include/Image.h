@@ -8,7 +8,12 @@
 #include "pixel.h"
 #include "edge.h"
 #include "utils.h"
+#include "PointGrid.h"
+#include "StitchGrid.h"
+#include "StitchCost.h"
+#include "EulerTourForest.h"
 
+#include <cstdint>
 #include <vector>
 #include <deque>
 #include <list>
@@ -29,16 +34,28 @@ private:
         unsigned char *pixmap;
         unsigned char **matrix;  // access in true matrix style
 
+        // summed area table per channel, (height + 1) x (width + 1), entry
+        // (h, w) holds the sum over rows < h and columns < w
+        // sums wrap around at 2^32, a rectangle still comes out exact as long
+        // as its own sum fits, i.e. for anything under 2^24 pixels
+        std::vector<uint32_t> integral[4];
+        unsigned char integralValid;  // one bit per channel, cleared on write
+
+        // build the table of channel 'c' unless it is up to date
+        void buildIntegral(int c);
+
         // get neighbors for input pixel
         std::vector<vec2> generateNeighbors(vec2& pixel, int ex, int ey);
-        // overload
-        static std::vector<vec2> generateNeighbors(
+        // overload, writes the ids of the points around 'current' into
+        // 'neighbors' so the caller can reuse the buffer
+        // an empty 'visited' means nothing has been visited yet
+        static void generateNeighbors(
           const vec2 &current,
-          std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-          const std::unordered_set<vec2, HashVec> &visited,
+          const PointGrid &grid,
+          const std::vector<bool> &visited,
           const float radius,
-          const int BUCKET_SIZE,
-          const std::vector<edge> &segments
+          const std::vector<edge> &segments,
+          std::vector<int> &neighbors
         );
 
         void fillNeighbors(int ch, int cw, int length, std::vector<vec2> &neighbors);
@@ -51,11 +68,6 @@ private:
         float(*cost)(vec2 &, vec2 &, vec2 &),
         const std::vector<bool> &visited);
 
-        void genPathUtil(vec2 current,
-                         vec2 parent,
-                         std::unordered_map<vec2, std::list<vec2>, HashVec> &adj,
-                         std::unordered_map<vec2, unsigned char, HashVec> &densities,
-                         std::vector<vec2> &path);
 public:
         Image(int width, int height, int channels);
 
@@ -81,12 +93,20 @@ public:
         }
 
         void setpixel(int x, int y, pixel pix) {
+            integralValid = 0;
             matrix[x][4*y] = pix.r;
             matrix[x][4*y + 1] = pix.g;
             matrix[x][4*y + 2] = pix.b;
             matrix[x][4*y + 3] = pix.a;
         }
 
+        // sum and mean of channel 'c' (0 = red ... 3 = alpha) over rows
+        // [h0, h1) and columns [w0, w1), clipped to the image, in constant time
+        // the summed area table of a channel is built on the first query after
+        // a write, so mixing writes and queries rebuilds it every time
+        uint64_t regionSum(int c, int h0, int w0, int h1, int w1);
+        float regionMean(int c, int h0, int w0, int h1, int w1);
+
         // paint the image white
         void init(unsigned char b=255);
 
@@ -123,10 +143,12 @@ public:
         void drawLineBresenham(int xStart, int yStart, int xEnd, int yEnd);
 
         // iterative stitch planning
+        // the cost model is a template parameter, see StitchCost.h
+        template <typename Cost>
         void plan(std::vector<edge> &graph,
                   std::vector<vec2> &nodes,
                   std::vector<vec2> &normals,
-                  float(*cost)(vec2 &, vec2 &, vec2 &));
+                  Cost cost);
 
         // a new approach to density
         std::vector<edge> planWithDensity(const std::vector<vec2> &normals,
@@ -189,49 +211,96 @@ public:
                                   bool end = false);
 
         // overload, return adj list representing the Shortest Path Tree
+        // 'start' is a point id, i.e. an index into the points of 'grid'
+        // cost1 scores a stitch against the normal map, cost2 scores the
+        // turn from the previous stitch, see StitchCost.h
+        template <typename Cost1, typename Cost2>
+        std::vector<edge> dijkstra(
+                                   const int start,
+                                   const PointGrid &grid,
+                                   StitchGrid &stitchGrid,
+                                   const std::vector<vec2> &normals,
+                                   Cost1 cost1,
+                                   Cost2 cost2,
+                                   const std::vector<edge>& segments
+                                  );
+
+        // overload, grows the tree out of all of 'starts' at once, only into
+        // the points 'open' allows (all of them if it is empty)
+        // the starts get no edge of their own, so the result hangs off them
+        template <typename Cost1, typename Cost2>
         std::vector<edge> dijkstra(
-                                   const vec2 &start,
-                                   std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-                                   std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets,
-                                   const int BUCKET_SIZE,
+                                   const std::vector<int> &starts,
+                                   const std::vector<bool> &open,
+                                   const PointGrid &grid,
+                                   StitchGrid &stitchGrid,
                                    const std::vector<vec2> &normals,
-                                   float(*cost1)(vec2 &, vec2 &, vec2 &),
-                                   float(*cost2)(vec2 &, vec2 &, vec2 &),
+                                   Cost1 cost1,
+                                   Cost2 cost2,
                                    const std::vector<edge>& segments
                                   );
 
-        vec2 getBestNode(const vec2 &v,
+        // lowest cost neighbor of point 'v' outside of the tree of 'v'
+        // 'vertex' maps point ids to the vertices of 'forest'
+        template <typename Cost>
+        vec2 getBestNode(const int v,
         const std::vector<vec2> &normals,
-        float(*cost)(vec2 &, vec2 &, vec2 &),
-        std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-        std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets,
-        std::unordered_map<vec2, int, HashVec> group,
+        Cost cost,
+        const PointGrid &grid,
+        StitchGrid &stitchGrid,
+        const EulerTourForest &forest,
+        const std::vector<int> &vertex,
         const float radius,
-        const int BUCKET_SIZE,
         float &bestCost,
-        int groupNumber,
         std::vector<edge> &segments
         );
 
         // cleanup jumps
+        template <typename Cost>
         std::unordered_map<vec2, std::list<vec2>, HashVec> cleanup(
           const std::vector<vec2> &normals,
           const std::vector<edge> &graph,
-          float(*cost)(vec2 &, vec2 &, vec2 &),
-          std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-          std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets,
-          const int BUCKET_SIZE,
+          Cost cost,
+          const PointGrid &grid,
+          StitchGrid &stitchGrid,
           std::vector<edge> &segments);
 
+        // overload, only the jumps among 'repair' (edges of 'graph') are fixed
+        template <typename Cost>
+        std::unordered_map<vec2, std::list<vec2>, HashVec> cleanup(
+          const std::vector<vec2> &normals,
+          const std::vector<edge> &graph,
+          const std::vector<edge> &repair,
+          Cost cost,
+          const PointGrid &grid,
+          StitchGrid &stitchGrid,
+          std::vector<edge> &segments);
+
+        // join the trees of 'graph' (a forest over the points of 'grid') with
+        // stitches of up to 'radius' out of the points 'around', cheapest
+        // first and none crossing the stitches of 'stitchGrid'
+        // returns the new stitches, which are added to 'stitchGrid'
+        template <typename Cost>
+        std::vector<edge> joinTrees(
+          const std::vector<vec2> &normals,
+          const std::vector<edge> &graph,
+          const std::vector<int> &around,
+          Cost cost,
+          const PointGrid &grid,
+          StitchGrid &stitchGrid,
+          const float radius,
+          const std::vector<edge> &segments);
+
         // clip jump stitches
         std::vector<edge> clipJumps(const std::vector<vec2> &normals,
                                     const std::vector<edge> &graph,
                                     float(*cost)(vec2 &, vec2 &, vec2 &));
 
         // find all jumps
+        template <typename Cost>
         std::vector<edge> findJumps(const std::vector<vec2> &normals,
                                     const std::vector<edge> &graph,
-                                    float(*cost)(vec2 &, vec2 &, vec2 &));
+                                    Cost cost);
 
         // sampling
         void sample(int size);
@@ -245,26 +314,29 @@ public:
         // convert density map into a graph
         std::unordered_map<vec2, std::vector<vec2>, HashVec> genGraph();
 
-        // overload, buckets is a bin lattice essentially
+        // overload, the grid is a bin lattice essentially
         std::unordered_map<vec2, std::vector<vec2>, HashVec> genGraph(
           const vec2 &start,
-          std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-          const int BUCKET_SIZE,
+          const PointGrid &grid,
           const std::vector<vec2> &normals,
           float(*cost)(vec2 &, vec2 &, vec2 &)
         );
 
         // generate a path from the graph traversal of a Dijsktra SPT
         // store the final path in 'path'
+        // with 'zigzags' every stitch is replaced by its zig-zag, otherwise
+        // the zig-zags are never computed
         void genPath(std::unordered_map<vec2, std::list<vec2>, HashVec> &adj,
                      std::unordered_map<vec2, unsigned char, HashVec> &densities,
-                     std::vector<vec2> &path);
+                     std::vector<vec2> &path,
+                     const bool zigzags = false);
 
         // prim!
+        template <typename Cost>
         std::vector<edge> prim(
           std::unordered_map<vec2, std::vector<vec2>, HashVec> &graph,
           const std::vector<vec2> &normals,
-          float(*cost)(vec2 &, vec2 &, vec2 &)
+          Cost cost
         );
 
         // add some fuzziness to the normal map
@@ -285,6 +357,13 @@ public:
         std::vector<vec2> genPoints(std::vector<unsigned char> &densityPoints,
                                     const int SUBGRID_SIZE);
 
+        // the same, only for the blocks [h0, h1) x [w0, w1) of the grid, in
+        // blocks rather than pixels
+        std::vector<vec2> genPoints(std::vector<unsigned char> &densityPoints,
+                                    const int SUBGRID_SIZE,
+                                    const int h0, const int w0,
+                                    const int h1, const int w1);
+
         // draw stitches to a custom image
         void drawStitches(std::vector<edge> &graph);
 };
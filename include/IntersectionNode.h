@@ -40,6 +40,10 @@ public:
 	const PixelRGB& Get_AverageColor() const;
 	const std::vector<VoronoiPoint*>& Get_IntersectingPoints() const;
 
+	// Index of the node in the table of the layer it was made on, which pixels refer to it by.
+	int Get_LayerIndex() const;
+	void Set_LayerIndex(int index);
+
 	bool EnvelopesSamePoints(const IntersectionNode& other) const;
 
 private:
@@ -51,6 +55,7 @@ private:
 
 	int identifier;
 	int voronoiZone;
+	int layerIndex = -1;
 	Vector2D position;
 
 	float averageDensity;
@@ -1,15 +1,19 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <unordered_map>
 
-#include "DynamicColor.h"
+#include "VoronoiPoint.h"
+#include "IntersectionNode.h"
+#include "PixelRGB.h"
 
 class Layer
 {
 public:
 
-	// Using this will make pixels dynamic and EDITABLE with voronoi points.
+	// Using this will make pixels dynamic and EDITABLE with voronoi points. Nothing is allocated
+	// per pixel until the first point is added, and then only over the zone's bounding box.
 	Layer(int sizeX, int sizeY, int zone);
 
 	// Using this will load pixels with data from an image and the map is NOT editable.
@@ -18,6 +22,15 @@ public:
 
 	void AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPt, bool updateBarycentric = true);
 
+	/*
+	 *	Replaces all points of this layer with the given ones and builds the layer from
+	 *  scratch: closest points, intersection nodes, triangles and colors of all pixels,
+	 *  in one pass over the rows split across numThreads threads (0 = one per core).
+	 *  Much faster than adding the points one by one. Where two points are equally
+	 *  close, the one earlier in the list wins, the same as if added in that order.
+	 */
+	void Rebuild(const std::vector<std::shared_ptr<VoronoiPoint>>& points, int numThreads = 0);
+
 	/*
 	 *	Removes a node from this layer. Doesn't rebuild though, so use if you are planning to do that. 
 	 */
@@ -51,13 +64,20 @@ public:
 	void RenderLayer(SDL_Renderer* rend, bool showDebug);
 
 	/*
-	 *	Returns reference to the exact pixel that is finally affected by the state of the
-	 *  layer currently. This allows us to track specific pixel values to construct
-	 *  the final texture outside of this scope.
+	 *	Gives the layer the final normal/density pixmaps it draws into. Only pixels marked
+	 *  with Set_InZone are ever written to.
+	 */
+	void Set_OutputPixmaps(PixelRGB** normalPixels, PixelRGB** densityPixels);
+
+	/*
+	 *	Marks a pixel as part of this layer's zone, so the layer's color for it ends up
+	 *  in the final texture, and copies its current color over. The zone must be
+	 *  complete before the first point is added; marking pixels in row major order
+	 *  keeps it small until then.
 	 * 
 	 *  FOR EFFICIENCY SAKE this doesn't bound check so don't pass in out of bounds coords.
 	 */
-	void Set_PixelRefs(int x, int y, PixelRGB* normalPix, PixelRGB* densityPix);
+	void Set_InZone(int x, int y);
 
 	bool Get_IsEditable()
 	{
@@ -66,24 +86,132 @@ public:
 
 private:
 	
-	bool editable = true;
-	int sizeX, sizeY;	// Caches layer size; should be same as main window.
+	static const int ROW_BATCH = 16;									// Rows handed to a thread at a time when rebuilding.
+	static const unsigned int NO_INDEX = 0xFFFFFFFF;					// No closest point/triangle for a pixel.
+	static const int BARY_SCALE = 65535;								// Barycentric coordinates are stored as fractions of this.
 
-	PixelRGB** rawNormalData;
-	PixelRGB** rawDensityData;
-	std::vector<std::vector<DynamicColor*>> normalMap;					// DynamicColor instances for this layer; covers whole screen although all may not be seen.
-	std::vector<DynamicColor*> pixelsToUpdate;							// Pixels to update next loop.
+	bool editable = true;
+	bool materialized = false;		// Whether the pixel planes below exist yet, see Materialize.
+	int sizeX, sizeY;				// Size of the area the layer covers: the main window, or its zone's bounding box once materialized.
+	int originX = 0, originY = 0;	// Top left of that area on screen. Pixel coords below are relative to it.
+	int zone;
+
+	PixelRGB** rawNormalData = nullptr;									// Image of a static layer; editable layers don't have one.
+	PixelRGB** rawDensityData = nullptr;
+	PixelRGB** normalOutput = nullptr;									// Final pixmaps, see Set_OutputPixmaps.
+	PixelRGB** densityOutput = nullptr;
+
+	// Voronoi state of every pixel of an editable layer, one plane per field, row major
+	// like the pixmaps. Covers the zone's bounding box, whose edges act like the edges
+	// of the screen, but only pixels in the zone itself are triangulated and colored.
+	std::vector<unsigned int> closestSite;								// Index into sites.
+	std::vector<unsigned int> triNodeA, triNodeB;						// Indices into nodeTable of the triangle the pixel is in.
+	std::vector<unsigned short> baryU, baryV, baryW;					// Barycentric coordinates within that triangle, times BARY_SCALE.
+	std::vector<unsigned char> inZone;									// 1 if the pixel shows in the final texture.
+
+	// Points and nodes pixels refer to by index. Removed points and erased nodes stay
+	// in here, as pixels may still use them until they're updated, and are only let
+	// go of when the whole layer is rebuilt or cleared.
+	std::vector<std::shared_ptr<VoronoiPoint>> sites;
+	std::vector<std::shared_ptr<IntersectionNode>> nodeTable;
+
+	std::vector<int> pixelsToUpdate;									// Pixels (row major indices) to update next loop.
 
 	std::unordered_map<int, std::shared_ptr<VoronoiPoint>> ownedPoints;	// Pts created on this layer; still globably accessible in main SketchProgram.
 	std::unordered_map<int, std::shared_ptr<IntersectionNode>> createdNodes; // Interesection nodes on this layer.
 
+	static const int NODE_BUCKET_SIZE = 16;								// Side of the squares nodes are bucketed by, in pixels.
+	std::unordered_map<long long, std::vector<int>> nodeBuckets;		// IDs of createdNodes by the square they lie in, to find nodes near a pixel.
+
+	/*
+	 *	Horizontal run of pixels x0..x1 (inclusive) on row y.
+	 */
+	struct PixelRun
+	{
+		int y, x0, x1;
+	};
+
+	std::vector<PixelRun> zoneRuns;										// Pixels of the zone in screen coords, until the layer is materialized.
+
+	std::unordered_map<int, std::vector<PixelRun>> cellRuns;			// Pixels of every point's cell by point ID, as runs in row major order.
+
+	std::vector<unsigned int> floodMarks;								// Per pixel (row major), the insert that last visited it. Allocated on the first insert.
+	unsigned int floodStamp = 0;										// Stamp of the current insert.
+
+	/*
+	 *	Allocates the pixel planes over the bounding box of the zone, if not done yet.
+	 *  A layer without any zone pixels covers the whole main window.
+	 */
+	void Materialize();
+
+	/*
+	 *	Position of a pixel on screen.
+	 */
+	Vector2D PixelPosition(int index) const
+	{
+		return Vector2D(index % sizeX + originX, index / sizeX + originY);
+	}
+
+	/*
+	 *	Adds/removes a node to/from createdNodes, keeping nodeBuckets and nodeTable in sync.
+	 *  Always go through these rather than touching createdNodes directly. ClearNodes also
+	 *  empties nodeTable, so the triangles of all pixels must be reset along with it.
+	 */
+	void InsertNode(const std::shared_ptr<IntersectionNode>& node);
+	void EraseNode(int nodeID);
+	void ClearNodes();
+
+	/*
+	 *	Visits the pixels the point sites[newSite] takes over from their current closest points,
+	 *  making it their closest point and moving them into its cell runs, and returns
+	 *  them in column major order. Only the new cell and a thin band around it are
+	 *  visited, not the whole layer.
+	 */
+	std::vector<int> FloodNewCell(unsigned int newSite);
+
+	/*
+	 *	Takes the given pixels (row major indices, sorted) out of a point's cell runs.
+	 */
+	void RemoveFromCell(int pointID, const std::vector<int>& pixels);
+
+	/*
+	 *	Appends all pixels of a point's cell. Costs as much as the cell is big.
+	 */
+	void AppendCellPixels(int pointID, std::vector<int>& pixels);
+
+	/*
+	 *	Cell runs of all points from scratch, off the closest point of every pixel.
+	 */
+	void BuildCellRuns();
+
+	/*
+	 *	Squared distance from a pixel to its closest point, FLT_MAX if it has none.
+	 */
+	float SqrDistanceToSite(int index) const;
+
+	/*
+	 *	Forgets the closest point and triangle of a pixel, and resets its color to
+	 *  the default if resetColor is set.
+	 */
+	void ClearPixel(int index, bool resetColor);
+
+	/*
+	 *	Finds the triangle the pixel is in, formed by its closest point and two adjacent
+	 *  nodes, and its barycentric coordinates within it. Keeps the previous triangle if
+	 *  none is found. Given the Helpers::PseudoAngle of each of the point's nodes, in the
+	 *  order AddNode sorts them, the triangle is picked by a binary search on the pixel's
+	 *  angle, and only if that one misses are all of them tried.
+	 */
+	void UpdateTriangle(int index, const float* nodeAngles = nullptr);
+
 	/*
-	 *	Helper function for detecting intersection points between voronoi cells.
+	 *	Updates the pixel's color based on its closest point and triangle. Pixels outside
+	 *  the zone aren't drawn.
 	 */
-	void CheckForIntersections(const std::vector<DynamicColor*>& toCheck);
+	void UpdatePixel(int index);
 
 	/*
 	 *	Updates the barycentric coordinates for all pixels in the list.
 	 */
-	void BarycentricUpdate(const std::vector<DynamicColor*>& toUpdate);
+	void BarycentricUpdate(const std::vector<int>& toUpdate);
 };
\ No newline at end of file
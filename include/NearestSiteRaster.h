@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "Vector2D.h"
+
+/*
+ *	Nearest site of every pixel of a layer, found in one pass over the pixels.
+ *	Sites are bucketed in a grid of about one site per bucket, and every 16 x 16
+ *	tile of pixels only looks at the sites of the buckets around it, widening the
+ *	search until no site outside could be nearer than the nearest one found. That
+ *	is exact, and costs about the same per pixel however many sites there are,
+ *	where adding the sites one at a time touches every pixel per site.
+ *
+ *	Ties go to the site that comes first in the list. Nothing per pixel is kept,
+ *	the result goes straight into the caller's plane.
+ */
+class NearestSiteRaster
+{
+public:
+
+	static const unsigned int NO_SITE = 0xFFFFFFFF;
+
+	NearestSiteRaster(int sizeX, int sizeY);
+
+	/*
+	 *	Writes the index into sites of the site nearest to every pixel, in pixel
+	 *	coordinates, to the sizeX * sizeY entries of nearest, row major, NO_SITE
+	 *	if there are no sites. The rows of tiles are split over numThreads threads
+	 *	(0 = one per core).
+	 */
+	void Build(const std::vector<Vector2D>& sites, unsigned int* nearest, int numThreads = 0);
+
+private:
+
+	static const int TILE_SIZE = 16;
+
+	int sizeX, sizeY;
+
+	// Site positions, split so the distance loops stream through them.
+	std::vector<float> siteX, siteY;
+
+	// Sites by bucket, in compressed row form: bucket b holds bucketSites[bucketStart[b] .. bucketStart[b + 1]).
+	int bucketSize, bucketsX, bucketsY;
+	std::vector<int> bucketStart, bucketSites;
+
+	// The caller's plane, while building.
+	unsigned int* nearest;
+
+	/*
+	 *	Fills in the pixels of the tile with top left corner (tileX, tileY), using
+	 *	candidates as scratch space.
+	 */
+	void BuildTile(int tileX, int tileY, std::vector<int>& candidates);
+};
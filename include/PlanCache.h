@@ -0,0 +1,82 @@
+// Header file for a content addressed cache of planning results
+// the points (with their spatial index) and the plan of a run are stored
+// under a hash of everything they were computed from: the maps, the sampler
+// and cost parameters and the random seed. a run with the same inputs reads
+// them back instead of sampling and planning again, so exporting the same
+// design again, or under another name or format, costs next to nothing
+// entries are small binary files, one per key, written to a temporary file
+// first and renamed into place so that runs in parallel never see half a file
+// the cache can be deleted at any time
+
+#ifndef PLANCACHE_H
+#define PLANCACHE_H
+
+#include "Image.h"
+#include "PointGrid.h"
+#include "StitchPlanner.h"
+#include "PoissonSampler.h"
+#include "QuadtreeSampler.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 64 bit FNV-1a hash of whatever is fed into it
+class CacheKey {
+private:
+        uint64_t hash;
+
+public:
+        CacheKey() : hash(0xcbf29ce484222325ull) {}
+
+        void add(const void *data, size_t size);
+
+        template <typename T>
+        void add(const T &value) { add(&value, sizeof(T)); }
+
+        // size and pixels
+        void addImage(Image *image);
+
+        uint64_t value() const { return hash; }
+
+        // 16 hex digits
+        std::string name() const;
+};
+
+// everything the points of a run depend on
+CacheKey pointsCacheKey(Image *densityMap, const PointSampler sampler,
+                        const int subgridSize,
+                        const QuadtreeParams &quadtree = QuadtreeParams(),
+                        const CVTParams &cvt = CVTParams());
+
+// everything the plan of a run depends on, on top of its points
+// 'normalMap' is the one handed to the planner
+CacheKey planCacheKey(const CacheKey &points, Image *normalMap,
+                      const PlanParams &params, const int numStarts,
+                      const PlanScore score);
+
+class PlanCache {
+private:
+        std::string directory;
+
+        std::string path(const CacheKey &key, const char *kind) const;
+
+public:
+        // a cache without a directory finds nothing and stores nothing
+        PlanCache() {}
+        PlanCache(const std::string &directory);
+
+        bool enabled() const { return !directory.empty(); }
+
+        // false if there is no (readable) entry for 'key'
+        bool loadPoints(const CacheKey &key, PointGrid &grid,
+                        std::vector<unsigned char> &densityPoints) const;
+        bool loadPlan(const CacheKey &key, PlanResult &result) const;
+
+        // false if the entry could not be written, the run goes on regardless
+        bool storePoints(const CacheKey &key, const PointGrid &grid,
+                         const std::vector<unsigned char> &densityPoints) const;
+        bool storePlan(const CacheKey &key, const PlanResult &result) const;
+};
+
+#endif
@@ -0,0 +1,59 @@
+// Header file for a uniform grid spatial index over the stitch points
+// the grid is stored in compressed row form so a cell is one contiguous
+// run of points, and radius queries never touch a hash table
+
+#ifndef POINTGRID_H
+#define POINTGRID_H
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "glm/vec2.hpp" // glm::vec2
+#include "glm/gtx/transform.hpp"
+
+using glm::vec2;
+
+class PointGrid {
+private:
+        float cellSize;
+        int cols, rows;
+        vec2 origin;  // lower corner of cell (0, 0)
+
+        // the points in their original order, ids index into this
+        std::vector<vec2> points;
+
+        // cellStart[c] ... cellStart[c + 1] is the range of cell 'c'
+        // in the arrays below, which are sorted by cell
+        std::vector<int> cellStart;
+        std::vector<int> cellIds;
+        std::vector<vec2> cellPoints;
+
+        int cellX(float x) const;
+        int cellY(float y) const;
+
+public:
+        PointGrid() : cellSize(1.0f), cols(0), rows(0), origin(0.0f, 0.0f) {}
+
+        PointGrid(const std::vector<vec2> &points, const float cellSize);
+
+        // (re)build the index over 'points' with square cells of 'cellSize'
+        void build(const std::vector<vec2> &points, const float cellSize);
+
+        // write the ids of all points p with minRadius <= |p - center| <= radius
+        // into 'out', which is cleared first so the caller can reuse it
+        void query(const vec2 &center, const float radius,
+                   std::vector<int> &out, const float minRadius = 0.0f) const;
+
+        // the whole index as raw bytes, read gives it back without rebuilding
+        // read returns false (and leaves an empty grid) on a broken stream
+        void write(std::ostream &out) const;
+        bool read(std::istream &in);
+
+        int size() const                           { return points.size(); }
+        float getCellSize() const                  { return cellSize; }
+        const vec2& getPoint(int id) const         { return points[id]; }
+        const std::vector<vec2>& getPoints() const { return points; }
+};
+
+#endif
@@ -0,0 +1,90 @@
+// Header file for a density adaptive poisson disk point sampler
+// an alternative to Image::genPoints: instead of jittering a grid per block,
+// points grow out Bridson style with a spacing that follows the density map,
+// so the density changes smoothly and no two points clump at block borders
+//
+// the map is cut into tiles, tiles of one colour of a 2 x 2 colouring are
+// never closer than a tile to each other and are sampled in parallel, the
+// next colour then fills in the borders around the points already placed
+
+#ifndef POISSONSAMPLER_H
+#define POISSONSAMPLER_H
+
+#include "Image.h"
+#include "PointGrid.h"
+#include "CentroidalVoronoi.h"
+
+#include <string>
+#include <vector>
+
+#include "glm/vec2.hpp" // glm::vec2
+
+using glm::vec2;
+
+// where the stitch points come from
+enum PointSampler {
+  SAMPLER_GRID,     // Image::genPoints, a jittered grid per block
+  SAMPLER_POISSON,  // PoissonSampler
+  SAMPLER_CVT,      // PoissonSampler, then relaxed to a centroidal voronoi tessellation
+  SAMPLER_QUADTREE  // QuadtreeSampler, spacing in millimetres
+};
+
+// parse "grid", "poisson", "cvt" or "quadtree", returns false if 'name' is
+// none of them
+bool parsePointSampler(const std::string &name, PointSampler &sampler);
+
+class PoissonSampler {
+private:
+        int width, height;
+
+        // per pixel: points per unit area we aim for, and the intensity
+        // genPoints would have stored for the pixel
+        std::vector<float> density;
+        std::vector<unsigned char> intensity;
+
+        // spacing at the highest and the lowest density of the map
+        float minRadius, maxRadius;
+
+        float tileSize;
+        int tileCols, tileRows;
+
+        // acceleration grid, cells are small enough to hold one point at most
+        float cellSize;
+        int cols, rows;
+        std::vector<vec2> cellPoint;
+        std::vector<char> occupied;
+
+        // bilinear density at 'p'
+        float densityAt(const vec2 &p) const;
+        float radiusAt(const float d) const;
+
+        // place 'p' unless there is a point closer than 'radius' already
+        bool tryAdd(const vec2 &p, const float radius);
+
+        // sample tile (tx, ty), only touches the grid within a tile of it
+        void sampleTile(const int tx, const int ty, std::vector<vec2> &out);
+
+public:
+        // targets the same number of points per area as genPoints
+        PoissonSampler(Image *densityMap);
+
+        // sample the whole map on up to 'numThreads' threads (0 = one per
+        // core), 'densityPoints' gets the intensity at every point
+        // the points only depend on the random seed, not on the threads
+        std::vector<vec2> sample(std::vector<unsigned char> &densityPoints,
+                                 int numThreads = 0);
+
+        // the same, building the planner's spatial index over the points
+        void sample(PointGrid &grid, const float gridCellSize,
+                    std::vector<unsigned char> &densityPoints,
+                    int numThreads = 0);
+
+        // move 'points' to a density weighted centroidal voronoi tessellation
+        // that keeps the density of the map, 'densityPoints' is refreshed
+        // returns the number of iterations run, see centroidalVoronoi
+        int relax(std::vector<vec2> &points,
+                  std::vector<unsigned char> &densityPoints,
+                  const CVTParams &params = CVTParams()) const;
+};
+
+#endif
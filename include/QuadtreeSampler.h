@@ -0,0 +1,208 @@
+// Header file for an adaptive quadtree point sampler
+// the map is cut into quadrants until every quadrant either expects only a
+// few points or is flat enough in density, then the points of each leaf are
+// jittered over a grid of strata within it
+// the spacing is given in millimetres rather than per block of pixels, so the
+// number of points follows the size of the design and not the resolution of
+// the density map: a 100 x 100 map of a 400 mm hoop gets as many points as a
+// 4000 x 4000 one
+// leaves are visited depth first in Z (Morton) order and their points handed
+// out as they are made
+// the mean and deviation of a quadrant come from a pyramid of sums over
+// blocks of the map, the finest blocks are as big as a power of two lets them
+// be while holding at most one point at the darkest density, so there are
+// about as many of them as the design can hold points, whatever the
+// resolution of the map. the map is read once to fill it, after that the time
+// goes with the number of points and the depth of the tree
+
+#ifndef QUADTREESAMPLER_H
+#define QUADTREESAMPLER_H
+
+#include "Image.h"
+#include "PointGrid.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm/vec2.hpp" // glm::vec2
+
+using glm::vec2;
+
+struct QuadtreeParams {
+  float mmPerPixel;    // size of a pixel of the density map
+  float spacing;       // stitch spacing at the darkest density, in mm
+  float maxDeviation;  // split quadrants whose intensity varies more than this
+  int maxLeafPoints;   // split quadrants that expect more points than this
+  int maxDepth;        // never split deeper than this
+
+  // a pixel is a millimetre in the exported designs, and at this spacing
+  // there are as many points per area as genPoints makes
+  QuadtreeParams()
+    : mmPerPixel(1.0f), spacing(1.09f), maxDeviation(8.0f),
+      maxLeafPoints(4), maxDepth(24) {}
+};
+
+class QuadtreeSampler {
+private:
+        Image *densityMap;
+        int width, height;
+        QuadtreeParams params;
+
+        // side of the root quadrant, in pixels, blockSize times a power of two
+        float rootSize;
+
+        // sums of the red channel and its square over a block of the map, and
+        // how many of its pixels are on the map
+        struct Block {
+          uint64_t sum, squares;
+          uint32_t pixels;
+        };
+
+        // side of the finest blocks, in pixels, a power of two
+        int blockSize;
+
+        // the blocks of every level of the pyramid, finest first, each level
+        // a row major grid of 'levelCols[l]' columns of blocks twice the side
+        // of the ones below, up to the one block of the root quadrant
+        std::vector<Block> pyramid;
+        std::vector<size_t> levelStart;
+        std::vector<int> levelCols;
+
+        // fill the pyramid from the map, once
+        void buildPyramid();
+
+        struct Node {
+          float x, y, size;  // top left corner and side, in pixels
+          int depth;
+        };
+
+        std::vector<Node> stack;
+
+        // the points of the current leaf
+        std::vector<vec2> leafPoints;
+        std::vector<int> strata;
+
+        // the leaf's random stream, see Random.h
+        static const uint64_t QUADTREE_STREAM = 3ull << 32;
+
+        // the block of the pyramid that 'node' is, or lies in if it is
+        // smaller than the finest ones
+        const Block &blockOf(const Node &node) const;
+
+        // expected number of points in 'node', false if it is outside the map
+        bool expectedPoints(const Node &node, float &expected);
+
+        // whether 'node' gets cut into quadrants rather than sampled
+        bool splits(const Node &node, const float expected);
+
+        // put the points of leaf 'node' into 'leafPoints'
+        void sampleLeaf(const Node &node, const float expected);
+
+        // generate, only visiting quadrants that overlap [x0, x1) x [y0, y1)
+        // and only the points inside it, drawing from 'stream'
+        template <typename Visit>
+        void walk(Visit visit, const float x0, const float y0,
+                  const float x1, const float y1, const uint64_t stream);
+
+public:
+        // the pyramid is filled on the first sample, the map must not change
+        // while sampling
+        QuadtreeSampler(Image *densityMap,
+                        const QuadtreeParams &params = QuadtreeParams());
+
+        // the intensity genPoints would have stored for a point
+        unsigned char intensityAt(const vec2 &p);
+
+        // call visit(point) for every point, in Morton order, in pixels
+        // the points only depend on the random seed
+        template <typename Visit>
+        void generate(Visit visit);
+
+        // the same, only for the points in [x0, x1) x [y0, y1), quadrants
+        // outside it are never visited so the cost goes with its area
+        // every rectangle draws from its own stream, the points are fresh
+        // ones and not those generate would have made there
+        template <typename Visit>
+        void generate(Visit visit, const float x0, const float y0,
+                      const float x1, const float y1);
+
+        // all points at once, 'densityPoints' gets the intensity at every point
+        std::vector<vec2> sample(std::vector<unsigned char> &densityPoints);
+
+        // the points of the rectangle [x0, x1) x [y0, y1), see generate
+        std::vector<vec2> sample(std::vector<unsigned char> &densityPoints,
+                                 const float x0, const float y0,
+                                 const float x1, const float y1);
+
+        // the same, building the planner's spatial index over the points
+        void sample(PointGrid &grid, const float gridCellSize,
+                    std::vector<unsigned char> &densityPoints);
+};
+
+template <typename Visit>
+void QuadtreeSampler::generate(Visit visit) {
+
+  const float inf = std::numeric_limits<float>::infinity();
+
+  walk(visit, -inf, -inf, inf, inf, QUADTREE_STREAM);
+}
+
+template <typename Visit>
+void QuadtreeSampler::generate(Visit visit, const float x0, const float y0,
+                               const float x1, const float y1) {
+
+  // one stream per top left pixel, all within the sampler's block
+  const int w = std::min(std::max((int)x0, 0), width - 1);
+  const int h = std::min(std::max((int)y0, 0), height - 1);
+
+  walk(visit, x0, y0, x1, y1, QUADTREE_STREAM + 1 + (uint64_t)h * width + w);
+}
+
+template <typename Visit>
+void QuadtreeSampler::walk(Visit visit, const float x0, const float y0,
+                           const float x1, const float y1,
+                           const uint64_t stream) {
+
+  if (pyramid.empty()) buildPyramid();
+
+  // leave the thread's own generator as it was
+  Xoshiro256 saved = threadRandom();
+  seedThreadRandom(stream);
+
+  stack.assign(1, Node{0.0f, 0.0f, rootSize, 0});
+
+  while (!stack.empty()) {
+    const Node node = stack.back();
+    stack.pop_back();
+
+    if (node.x >= x1 || node.y >= y1 || node.x + node.size <= x0 ||
+        node.y + node.size <= y0) continue;
+
+    float expected;
+    if (!expectedPoints(node, expected)) continue;
+
+    if (splits(node, expected)) {
+      const float half = node.size / 2;
+
+      // pushed backwards so they come off top left, top right, bottom
+      // left, bottom right, which is Z order
+      stack.push_back(Node{node.x + half, node.y + half, half, node.depth + 1});
+      stack.push_back(Node{node.x, node.y + half, half, node.depth + 1});
+      stack.push_back(Node{node.x + half, node.y, half, node.depth + 1});
+      stack.push_back(Node{node.x, node.y, half, node.depth + 1});
+      continue;
+    }
+
+    sampleLeaf(node, expected);
+
+    for (const vec2 &p : leafPoints)
+      if (p.x >= x0 && p.x < x1 && p.y >= y0 && p.y < y1) visit(p);
+  }
+
+  threadRandom() = saved;
+}
+
+#endif
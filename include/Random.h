@@ -0,0 +1,89 @@
+// Header file for the random number generation used all over the planner
+// one xoshiro256** generator per thread, all of them derived from a single
+// global seed, so the same seed gives the same points and the same plans
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+// xoshiro256** by Blackman and Vigna, small, fast and good enough for
+// anything we do with it, see https://prng.di.unimi.it
+// models UniformRandomBitGenerator, so it also plugs into <random>
+class Xoshiro256 {
+private:
+        uint64_t s[4];
+
+        static uint64_t rotl(const uint64_t x, int k) {
+          return (x << k) | (x >> (64 - k));
+        }
+
+public:
+        typedef uint64_t result_type;
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return UINT64_MAX; }
+
+        explicit Xoshiro256(uint64_t seed = 0) { this->seed(seed); }
+
+        // fill the state from 'seed' with splitmix64, as the authors suggest
+        void seed(uint64_t seed);
+
+        result_type operator()() {
+          const uint64_t result = rotl(s[1] * 5, 7) * 9;
+          const uint64_t t = s[1] << 17;
+
+          s[2] ^= s[0];
+          s[3] ^= s[1];
+          s[1] ^= s[2];
+          s[0] ^= s[3];
+          s[2] ^= t;
+          s[3] = rotl(s[3], 45);
+
+          return result;
+        }
+
+        // uniform in [0, n), n < 2^32
+        uint32_t below(uint32_t n) {
+          return (uint32_t)(((*this)() >> 32) * n >> 32);
+        }
+
+        // uniform in [0, 1)
+        double uniform() {
+          return ((*this)() >> 11) * (1.0 / 9007199254740992.0);
+        }
+};
+
+// the seed every thread's generator is derived from, 0 unless set
+// setting it restarts the generators of all threads on their next use
+void setRandomSeed(uint64_t seed);
+uint64_t getRandomSeed();
+
+// this thread's generator
+// threads get streams 0, 1, 2, ... in the order they first ask for one
+Xoshiro256& threadRandom();
+
+// restart this thread's generator on stream 'stream' of the global seed
+// work that may end up on any thread picks its own stream this way to stay
+// reproducible
+void seedThreadRandom(uint64_t stream);
+
+// uniform in [0, n) from this thread's generator
+inline uint32_t randomBelow(uint32_t n) { return threadRandom().below(n); }
+
+// uniform in [0, 1) from this thread's generator
+inline double randomUniform() { return threadRandom().uniform(); }
+
+// fisher-yates shuffle of [first, last) with this thread's generator
+// unlike std::shuffle it gives the same order with every standard library
+template <typename Iter>
+void shuffleRandomly(Iter first, Iter last) {
+  Xoshiro256 &g = threadRandom();
+
+  for (auto i = std::distance(first, last) - 1; i > 0; --i)
+    std::swap(*(first + i), *(first + g.below(i + 1)));
+}
+
+#endif
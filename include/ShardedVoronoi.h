@@ -0,0 +1,52 @@
+// Header file for building the voronoi cells of very many sites on several
+// threads
+// the sites are cut into vertical strips of equal site counts, every strip
+// runs its own sweep over the sites within a guard margin of it and keeps the
+// cells of its own sites
+// a cell is kept only once it is certain: the circle around each of its
+// corners through its site must not reach past the sites the sweep saw, or
+// else a site further out could cut the cell. strips with uncertain cells
+// are swept again over exactly the margin those circles need, so the cells
+// are the same as a single sweep over all the sites gives
+
+#ifndef SHARDEDVORONOI_H
+#define SHARDEDVORONOI_H
+
+#include <memory>
+#include <vector>
+
+#include "VoronoiDiagramGenerator.h"
+
+class ShardedVoronoi {
+private:
+        int numThreads;
+
+        // one generator per strip, kept so their memory is reused
+        std::vector<std::unique_ptr<VoronoiDiagramGenerator>> generators;
+
+        // per strip: the cells of its own sites, in compressed row form
+        std::vector<std::vector<int>> stripStart;
+        std::vector<std::vector<Point>> stripCorners;
+
+        // sweep strip 's' of the sites 'order' (sorted by x) owned from
+        // 'first' up to 'last', keeping the cells of the owned sites
+        void buildStrip(const int s, const std::vector<int> &order,
+                        const int first, const int last,
+                        const float *xValues, const float *yValues,
+                        const float box[4]);
+
+public:
+        // up to 'numThreads' strips, 0 = one per core
+        ShardedVoronoi(int numThreads = 0);
+
+        // the cells of all sites clipped to the box, the same as
+        // VoronoiDiagramGenerator::getCells after generateVoronoi
+        void generateCells(const float *xValues, const float *yValues,
+                           const int numPoints,
+                           const float minX, const float maxX,
+                           const float minY, const float maxY,
+                           std::vector<int> &cellStart,
+                           std::vector<Point> &cellCorners);
+};
+
+#endif
@@ -7,7 +7,6 @@
 #include <SDL2/SDL.h>
 
 #include "Vector2D.h"
-#include "DynamicColor.h"
 #include "Helpers.h"
 
 class SketchLine
@@ -5,6 +5,7 @@
 #include <vector>
 #include <set>
 #include <memory>
+#include <cstdint>
 #include <unordered_map>
 
 #include <SDL2/SDL.h>
@@ -15,7 +16,7 @@
 #include "PixelRGB.h"
 #include "SketchLine.h"
 #include "Helpers.h"
-#include "DynamicColor.h"
+#include "VoronoiPoint.h"
 #include "VectorField.h"
 #include "StitchResult.h"
 #include "Layer.h"
@@ -64,6 +65,7 @@ public:
 private:
 
 	std::vector<std::unique_ptr<StitchResult>> stitchResults;
+	std::shared_ptr<StitchPlanState> lastStitchPlan;		// What the last stitch was planned from, the next one builds on it
 
 	SDL_DisplayMode displayConfig;	// Display configurations (screen size, refresh rate, etc.)
 	SDL_Window* window;				// Window for SDL
@@ -107,6 +109,13 @@ private:
 	std::string defaultNormalMap = "";
 	std::string defaultDensityMap = "";
 	std::string zoneMapName = "";
+	int pStitchStarts = 1;					// Optional, planner starts to pick the best stitch from
+	PlanScore pStitchScore = SCORE_SCR;		// Optional, what makes one stitch better than another
+	PointSampler pPointSampler = SAMPLER_GRID;	// Optional, how the stitch points are placed
+	bool pHasStitchSeed = false;			// Optional, was a fixed seed given for the stitches?
+	uint64_t pStitchSeed = 0;				// Seed of every stitch if so, otherwise a new one each time
+	float pMmPerPixel = 0.0f;				// Optional, size of a window pixel in the design (100 mm over the width if not given)
+	float pStitchSpacing = 0.0f;			// Optional, stitch spacing at the darkest density in mm (QuadtreeParams default if not given)
 
 	Vector2D mousePos;						// Cached position of mouse in screen space.
 	Vector2D prevMousePos;					// Mouse position of previous frame; used to displace things with mouse movement.
@@ -179,11 +188,16 @@ private:
 
 	/*
 	 *	Generates the entire map based on current voronoi points that already have
-	 *	vertices/nodes determined. No optmization at all, just n^3 implementation that checks
-	 *  possible points with each pixel.
+	 *	vertices/nodes determined, then updates the vector field to match.
 	 */
 	void RebuildMapNaive();
 
+	/*
+	 *	Rebuilds every editable layer from scratch from the voronoi points in its zone,
+	 *  one parallel pass per layer.
+	 */
+	void RebuildLayers();
+
 	/*
 	 *	Deletes all nodes currently selected, if any. 
 	 */
@@ -0,0 +1,205 @@
+// Header file for the stitch cost models used by the planner
+// the planner takes its cost model as a template parameter, so any of the
+// functors below (or a plain cost function) is inlined into the search
+// loops instead of being called through a pointer for every edge
+
+#ifndef STITCHCOST_H
+#define STITCHCOST_H
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "glm/vec2.hpp" // glm::vec2
+#include "glm/gtx/transform.hpp"
+
+using glm::vec2;
+
+// the old style cost function, still accepted everywhere a cost model is
+typedef float(*CostFunction)(vec2 &, vec2 &, vec2 &);
+
+// a^x as exp(x ln a), the log is taken once up front
+class ExactPow {
+private:
+        float logBase;
+
+public:
+        ExactPow(float base = 1.0f) : logBase(std::log(base)) {}
+
+        float operator()(float x) const { return std::exp(x * logBase); }
+};
+
+// a^x read from a precomputed table over [lo, hi] with linear interpolation,
+// anything outside of the table falls back to exp()
+// the table is shared between copies, so passing one around by value is cheap
+class TablePow {
+private:
+        float logBase;
+        float lo, hi, scale;
+        std::shared_ptr<const std::vector<float>> table;
+
+public:
+        // the default range covers the exponents the planner uses:
+        // distances of up to 8 units and |cos| in [0, 1]
+        TablePow(float base = 1.0f, float lo = -8.0f, float hi = 1.0f,
+                 int size = 1024) :
+        logBase(std::log(base)), lo(lo), hi(hi), scale((size - 1) / (hi - lo))
+        {
+          std::vector<float> *t = new std::vector<float>(size + 1);
+
+          for (int i = 0; i < size; ++i)
+            (*t)[i] = std::exp((lo + i / scale) * logBase);
+
+          // one past the end, so the interpolation never reads out of bounds
+          (*t)[size] = (*t)[size - 1];
+
+          table.reset(t);
+        }
+
+        float operator()(float x) const {
+          if (!(lo <= x && x <= hi))
+            return std::exp(x * logBase);
+
+          float f = (x - lo) * scale;
+          int i = (int)f;
+          f -= i;
+
+          return (*table)[i] + f * ((*table)[i + 1] - (*table)[i]);
+        }
+};
+
+// cost of the stitch (u, v) against the preferred direction 'n' at 'u'
+// -alpha^-|v - u| * beta^|cos(v - u, n)|
+template <typename Pow = ExactPow>
+struct DirectionCost {
+  Pow alphaPow, betaPow;
+
+  DirectionCost(float alpha, float beta) : alphaPow(alpha), betaPow(beta) {}
+
+  float operator()(const vec2 &u, const vec2 &v, const vec2 &n) const {
+    float distance = glm::length(v - u);
+    float cosangle = 0.0f;
+
+    if (n.x != 0.0f || n.y != 0.0f)
+      cosangle = std::fabs(glm::dot(glm::normalize(v - u), glm::normalize(n)));
+
+    return -alphaPow(-distance) * betaPow(cosangle);
+  }
+};
+
+// cost of the stitch (v, w) following the stitch (u, v)
+// -alpha^-|w - v| * beta^-|cos(u - v, w - v)|
+template <typename Pow = ExactPow>
+struct TurnCost {
+  Pow alphaPow, betaPow;
+
+  TurnCost(float alpha, float beta) : alphaPow(alpha), betaPow(beta) {}
+
+  float operator()(const vec2 &u, const vec2 &v, const vec2 &w) const {
+    float cosangle = std::fabs(glm::dot(glm::normalize(u - v),
+                                        glm::normalize(w - v)));
+    float distance = glm::length(w - v);
+
+    return -alphaPow(-distance) * betaPow(-cosangle);
+  }
+};
+
+// scratch space for scoring a whole neighbor set at once
+// fill x, y with the varying end points, the scores end up in 'out'
+// reuse one batch across calls to keep the allocations out of the loops
+struct CostBatch {
+  std::vector<float> x, y;
+  std::vector<float> dist, cosangle;
+  std::vector<float> out;
+
+  void resize(size_t n) {
+    x.resize(n); y.resize(n);
+    dist.resize(n); cosangle.resize(n);
+    out.resize(n);
+  }
+
+  size_t size() const { return x.size(); }
+};
+
+// out[i] = cost(u, (x[i], y[i]), n), one call at a time
+template <typename Cost>
+void evalCosts(Cost cost, const vec2 &u, const vec2 &n, CostBatch &batch) {
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    vec2 a = u, b(batch.x[i], batch.y[i]), c = n;
+    batch.out[i] = cost(a, b, c);
+  }
+}
+
+// out[i] = cost(u, v, (x[i], y[i])), one call at a time
+template <typename Cost>
+void evalTurnCosts(Cost cost, const vec2 &u, const vec2 &v, CostBatch &batch) {
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    vec2 a = u, b = v, c(batch.x[i], batch.y[i]);
+    batch.out[i] = cost(a, b, c);
+  }
+}
+
+// the loops below work on plain float arrays with no calls or early exits,
+// so the compiler can vectorize them
+
+// batched DirectionCost, 'u' and 'n' are the same for the whole batch
+template <typename Pow>
+void evalCosts(const DirectionCost<Pow> &cost, const vec2 &u, const vec2 &n,
+               CostBatch &batch) {
+
+  const int count = batch.size();
+
+  const float *x = batch.x.data();
+  const float *y = batch.y.data();
+  float *dist = batch.dist.data();
+  float *cosangle = batch.cosangle.data();
+  float *out = batch.out.data();
+
+  // a zero normal has no preferred direction, cos = 0 everywhere
+  vec2 e(0.0f, 0.0f);
+  if (n.x != 0.0f || n.y != 0.0f) e = glm::normalize(n);
+
+  for (int i = 0; i < count; ++i) {
+    float dx = x[i] - u.x;
+    float dy = y[i] - u.y;
+    float d = std::sqrt(dx * dx + dy * dy);
+
+    dist[i] = d;
+    cosangle[i] = d > 0.0f ? std::fabs(dx * e.x + dy * e.y) / d : 0.0f;
+  }
+
+  for (int i = 0; i < count; ++i)
+    out[i] = -cost.alphaPow(-dist[i]) * cost.betaPow(cosangle[i]);
+}
+
+// batched TurnCost, the previous stitch (u, v) is the same for the whole batch
+template <typename Pow>
+void evalTurnCosts(const TurnCost<Pow> &cost, const vec2 &u, const vec2 &v,
+                   CostBatch &batch) {
+
+  const int count = batch.size();
+
+  const float *x = batch.x.data();
+  const float *y = batch.y.data();
+  float *dist = batch.dist.data();
+  float *cosangle = batch.cosangle.data();
+  float *out = batch.out.data();
+
+  const vec2 e = glm::normalize(u - v);
+
+  for (int i = 0; i < count; ++i) {
+    float dx = x[i] - v.x;
+    float dy = y[i] - v.y;
+    float d = std::sqrt(dx * dx + dy * dy);
+
+    dist[i] = d;
+    cosangle[i] = std::fabs(dx * e.x + dy * e.y) / d;
+  }
+
+  for (int i = 0; i < count; ++i)
+    out[i] = -cost.alphaPow(-dist[i]) * cost.betaPow(-cosangle[i]);
+}
+
+#endif
@@ -0,0 +1,35 @@
+// Header file for writing stitch plans out to embroidery files
+// (libembroidery csv and Tajima DST)
+// nothing in here needs a window, so it can run headless
+
+#ifndef STITCHEXPORT_H
+#define STITCHEXPORT_H
+
+#include "edge.h"
+
+#include <string>
+#include <vector>
+
+// write the stitches of 'graph' as a libembroidery csv file
+// 'isoff' flags the stitches that go against the normal map, 'width' is
+// the width of the map the plan was made on
+// returns false if the file could not be written
+bool writeStitchCSV(const std::string &filename,
+                    const std::vector<edge> &graph,
+                    const std::vector<bool> &isoff,
+                    const float width);
+
+// write the stitches of 'graph' as a Tajima DST file, one map unit being
+// 'mmPerUnit' millimetres of the design
+// the design is centred on the middle of the width x height map, stitches
+// longer than a DST record can hold are split, and the whole file is
+// written in a single pass over the stitches
+// 'label' goes into the header, at most 16 characters of it are kept
+// returns false if the file could not be written
+bool writeStitchDST(const std::string &filename,
+                    const std::vector<edge> &graph,
+                    const float width, const float height,
+                    const std::string &label,
+                    const float mmPerUnit = 1.0f);
+
+#endif
@@ -0,0 +1,64 @@
+// Header file for a uniform grid spatial index over stitches (segments)
+// a stitch is registered in every cell it passes through, so collision
+// queries only need to look at the cells the query segment passes through
+
+#ifndef STITCHGRID_H
+#define STITCHGRID_H
+
+#include "edge.h"
+#include "PointGrid.h"
+
+#include <vector>
+
+#include "glm/vec2.hpp" // glm::vec2
+
+using glm::vec2;
+
+class StitchGrid {
+private:
+        float cellSize;
+        int cols, rows;
+        vec2 origin;
+
+        std::vector<edge> stitches;
+
+        // ids of the stitches passing through each cell
+        std::vector<std::vector<int>> cells;
+
+        // range of rows the segment (u, v) passes through
+        void rowSpan(const vec2 &u, const vec2 &v, int &y0, int &y1) const;
+
+        // range of cells the segment (u, v) passes through in row 'cy'
+        void columnSpan(const vec2 &u, const vec2 &v, int cy, int &x0, int &x1) const;
+
+        int cellX(float x) const;
+        int cellY(float y) const;
+
+public:
+        StitchGrid() : cellSize(1.0f), cols(0), rows(0), origin(0.0f, 0.0f) {}
+
+        // grid covering the box [lo, hi] with square cells of 'cellSize'
+        StitchGrid(const vec2 &lo, const vec2 &hi, const float cellSize);
+
+        // add stitch (u, v) to every cell it crosses
+        void add(const vec2 &u, const vec2 &v);
+
+        // id of a stitch that (u, v) crosses, -1 if there is none
+        // stitches sharing an end point with (u, v) never count as crossings
+        int findCrossing(const vec2 &u, const vec2 &v) const;
+
+        bool crosses(const vec2 &u, const vec2 &v) const {
+          return findCrossing(u, v) != -1;
+        }
+
+        // batch query: drop every id in 'candidates' for which the stitch
+        // (u, points[id]) would cross a stitch in the grid
+        // the nearby stitches are gathered once for the whole batch
+        void filterCrossing(const vec2 &u, const PointGrid &points,
+                            std::vector<int> &candidates) const;
+
+        int size() const                    { return stitches.size(); }
+        const edge& getStitch(int id) const { return stitches[id]; }
+};
+
+#endif
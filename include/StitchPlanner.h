@@ -0,0 +1,166 @@
+// Header file for the stitch planning pipeline
+// dijkstra -> cleanup -> path generation over a set of points and a normal
+// map, with every run keeping its own state so that runs from different
+// starts can go in parallel
+
+#ifndef STITCHPLANNER_H
+#define STITCHPLANNER_H
+
+#include "Image.h"
+#include "PointGrid.h"
+#include "edge.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/vec2.hpp" // glm::vec2
+
+using glm::vec2;
+
+// cost parameters of one planning run, these used to be the file level
+// globals alpha1, beta1, alpha2 and beta2
+// how the cost models take their powers
+enum PlanCost {
+  COST_EXACT,   // exp() every time, see ExactPow
+  COST_TABLE    // read from a precomputed table, see TablePow
+};
+
+// parse "exact" or "table", returns false if 'name' is neither
+bool parsePlanCost(const std::string &name, PlanCost &cost);
+
+struct PlanParams {
+  float alpha1, beta1;  // stitch against the normal map, see DirectionCost
+  float alpha2, beta2;  // turn from the previous stitch, see TurnCost
+  float targetSCR;      // stitch count ratio to aim for when scoring by SCR
+  PlanCost cost;        // how the powers in both are taken
+
+  PlanParams() : alpha1(1.4f), beta1(2.05f), alpha2(2.2f), beta2(4.4f),
+                 targetSCR(0.0f), cost(COST_EXACT) {}
+};
+
+// what makes one plan better than another, lower scores win
+enum PlanScore {
+  SCORE_SCR,          // distance of the SCR from the target SCR
+  SCORE_RMS_ERROR,    // RMS error between the reversed and the original normal map
+  SCORE_OFF_PERCENT   // percentage of stitches flagged as off direction
+};
+
+// parse "scr", "rms" or "off", returns false if 'name' is none of them
+bool parsePlanScore(const std::string &name, PlanScore &score);
+
+// an axis aligned rectangle of the map, in pixels
+struct DirtyRect {
+  float x0, y0, x1, y1;
+
+  DirtyRect() : x0(0), y0(0), x1(0), y1(0) {}
+  DirtyRect(float x0, float y0, float x1, float y1)
+    : x0(x0), y0(y0), x1(x1), y1(y1) {}
+
+  // is 'p' inside, or within 'pad' of it?
+  bool near(const vec2 &p, const float pad = 0.0f) const {
+    return p.x >= x0 - pad && p.x < x1 + pad && p.y >= y0 - pad && p.y < y1 + pad;
+  }
+};
+
+// the tiles of 'tile' x 'tile' pixels where 'before' and 'after' differ, as
+// rectangles, one per run of changed tiles in a row of tiles
+// maps of different sizes differ everywhere
+std::vector<DirtyRect> findDirtyRects(Image *before, Image *after,
+                                      const int tile);
+
+// everything one planning run produces
+struct PlanResult {
+  int start;                // id of the start point
+  std::vector<edge> spt;    // dirty stitch plan, before cleanup
+  std::vector<edge> tree;   // the tree after cleanup, which the path walks
+  std::vector<vec2> path;   // final stitch path
+  std::vector<edge> graph;  // the path as stitches
+  std::vector<bool> isoff;  // per stitch in 'graph', flagged as off direction
+
+  float scr;
+  float rmsError;
+  float offPercent;
+  float score;              // the one picked by PlanScore
+
+  PlanResult() : start(-1), scr(0), rmsError(0), offPercent(0), score(0) {}
+};
+
+class StitchPlanner {
+private:
+        // normal map the planner works on, already flipped and blended
+        // every run reverses its own copy of it
+        Image *normalMap;
+
+        std::vector<vec2> normals;
+        PointGrid grid;
+        PlanParams params;
+
+        // no-go segments no stitch may cross
+        std::vector<edge> segments;
+
+        // reverse the normal map with the cleaned up tree 'adj', walk it into
+        // the path and score the run, the last steps of plan and replan
+        void finish(Image *map,
+                    std::unordered_map<vec2, std::list<vec2>, HashVec> &adj,
+                    const PlanScore score, PlanResult &result) const;
+
+        // plan and replan with the cost models taking their powers by 'Pow'
+        template <typename Pow>
+        PlanResult planWith(const int start, const PlanScore score) const;
+
+        template <typename Pow>
+        PlanResult replanWith(const PlanResult &previous,
+                              const std::vector<DirtyRect> &dirty,
+                              const int numStarts,
+                              const PlanScore score) const;
+
+public:
+        // cell size of the planner's point grid
+        static const int SUBREGION_SIZE = 4;
+
+        // 'normalMap' is copied, the caller keeps ownership
+        StitchPlanner(Image *normalMap, const std::vector<vec2> &points,
+                      const PlanParams &params = PlanParams());
+
+        // plan over an already built point grid, e.g. from PoissonSampler
+        // cells of any size work, SUBREGION_SIZE is what the planner would pick
+        StitchPlanner(Image *normalMap, const PointGrid &grid,
+                      const PlanParams &params = PlanParams());
+        ~StitchPlanner();
+
+        StitchPlanner(const StitchPlanner &) = delete;
+        StitchPlanner& operator=(const StitchPlanner &) = delete;
+
+        // one full run from the point with id 'start'
+        // runs share nothing but read only data, so they may go in parallel
+        PlanResult plan(const int start, const PlanScore score) const;
+
+        // run 'numStarts' plans from random starts on up to 'numThreads'
+        // threads (0 = one per core) and return the one with the lowest score
+        PlanResult planBest(const int numStarts, const PlanScore score,
+                            int numThreads = 0) const;
+
+        // plan again after the maps changed only inside 'dirty', reusing
+        // 'previous' everywhere else
+        // the planner has to be made with the new normal map over the points
+        // of 'previous', with those in 'dirty' replaced by fresh ones
+        // stitches within REPLAN_MARGIN of 'dirty' are dropped, the tree is
+        // grown into the gap from the stitches left around it, the pieces
+        // are joined up again and only the new stitches are checked for
+        // jumps, so the search costs go with the size of the edit
+        // when the pieces can't be joined into one tree, or there is no
+        // previous tree, everything is planned from 'numStarts' starts
+        PlanResult replan(const PlanResult &previous,
+                          const std::vector<DirtyRect> &dirty,
+                          const int numStarts,
+                          const PlanScore score) const;
+
+        // how far around a dirty rectangle stitches are planned again
+        static constexpr float REPLAN_MARGIN = 7.0f;
+
+        const std::vector<vec2>& getPoints() const { return grid.getPoints(); }
+};
+
+#endif
@@ -1,12 +1,37 @@
 #pragma once
 
 #include "Image.h"
+#include "StitchPlanner.h"
+#include "PoissonSampler.h"
+#include "QuadtreeSampler.h"
 #include "PixelRGB.h"
+#include "PointGrid.h"
 
 #include <memory>
+#include <cstdint>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
+/*
+ *	What a stitch was planned from, and its plan, so that the next stitch only
+ *  has to plan again where the maps were edited in between.
+ */
+struct StitchPlanState
+{
+	~StitchPlanState();
+
+	std::unique_ptr<Image> densityMap;			// Density map the points were sampled from
+	std::unique_ptr<Image> plannerMap;			// Normal map as the planner was given it
+	PointGrid grid;
+	std::vector<unsigned char> densityPoints;
+	PlanResult plan;
+
+	PointSampler sampler;
+	PlanScore score;
+	int numStarts;
+	uint64_t seed;
+};
+
 class StitchResult
 {
 public:
@@ -26,6 +51,73 @@ public:
 	 */
 	bool CreateStitches(bool createWindow = true);
 
+	/*
+	 *	Plan from this many random starts (in parallel, one thread per core)
+	 *  and keep only the result with the lowest score. A single start behaves
+	 *  the same as before.
+	 */
+	void Set_MultiStart(int numStarts, PlanScore score)
+	{
+		this->numStarts = (numStarts < 1) ? 1 : numStarts;
+		this->planScore = score;
+	}
+
+	/*
+	 *	Place the stitch points with the given sampler. The grid sampler
+	 *  behaves the same as before, poisson spaces them by the density map.
+	 */
+	void Set_PointSampler(PointSampler sampler)
+	{
+		this->pointSampler = sampler;
+	}
+
+	/*
+	 *	How big the design is: a pixel of the maps is 'mmPerPixel' mm of it,
+	 *  the quadtree sampler spaces the densest stitches 'spacing' mm apart and
+	 *  the grid sampler works in blocks of 'subgridSize' map pixels. The DST
+	 *  file is written in millimetres from these.
+	 */
+	void Set_Scale(float mmPerPixel, float spacing, int subgridSize)
+	{
+		this->mmPerPixel = mmPerPixel;
+		this->subgridSize = (subgridSize < 1) ? 1 : subgridSize;
+		quadtree.mmPerPixel = mmPerPixel;
+		quadtree.spacing = spacing;
+	}
+
+	/*
+	 *	Seed of all the randomness of the stitch (point jitter, starts and
+	 *  traversal order). Planned from scratch, the same maps and seed always
+	 *  give the same stitch. One built on the stitch before it (see
+	 *  Set_Previous) also depends on that stitch, and so on the edits in
+	 *  between. Only a fixed seed can ever be asked for again, so only then are the
+	 *  points and plan read from and kept in output/cache.
+	 */
+	void Set_Seed(uint64_t seed, bool fixed)
+	{
+		this->seed = seed;
+		this->fixedSeed = fixed;
+	}
+
+	/*
+	 *	The state of an earlier stitch. If it was made the same way and from
+	 *  the same seed, and the maps only changed in part since, only the
+	 *  stitches around the changes are planned again and the rest of its plan
+	 *  is kept.
+	 */
+	void Set_Previous(std::shared_ptr<StitchPlanState> previous)
+	{
+		this->previousPlan = previous;
+	}
+
+	/*
+	 *	What this stitch was planned from, null until CreateStitches ran.
+	 */
+	std::shared_ptr<StitchPlanState> Get_PlanState()
+	{
+		return planState;
+	}
+
 	Image* Get_StitchImage()
 	{
 		return stitchImg.get();
@@ -44,6 +136,15 @@ private:
 
 	static int resultID;
 
+	/*
+	 *	Plans from the previous stitch, only sampling and planning again where
+	 *  the density map or the planner's normal map changed. Returns false,
+	 *  touching nothing, when the previous stitch can't be built on and
+	 *  everything has to be planned.
+	 */
+	bool PlanIncrementally(const PlanParams& params, Image* plannerMap, PointGrid& grid,
+		std::vector<unsigned char>& densityPoints, PlanResult& result);
+
 	std::unique_ptr<Image> stitchImg;
 	std::unique_ptr<Image> densityMapImg;
 	std::unique_ptr<Image> normalMapImg;
@@ -51,5 +152,16 @@ private:
 	SDL_Renderer* renderer;
 	SDL_Window* window;
 
-	const int subgridSize = 10;			// Hardcoded subgrid size of 10 for now.
+	int subgridSize = 10;				// Side of a grid sampler block, in map pixels
+	float mmPerPixel = 1.0f;			// Size of a map pixel in the design
+	QuadtreeParams quadtree;			// Spacing of the quadtree sampler, in mm
+
+	int numStarts = 1;					// Number of starts to plan from, best one is kept
+	PlanScore planScore = SCORE_SCR;	// How to pick the best of those starts
+	PointSampler pointSampler = SAMPLER_GRID;	// How to place the stitch points
+	uint64_t seed = 0;					// Seed of the points and plans, part of the cache keys
+	bool fixedSeed = false;				// Was it given, rather than rolled for this stitch?
+
+	std::shared_ptr<StitchPlanState> previousPlan;	// Earlier stitch to build on, if any
+	std::shared_ptr<StitchPlanState> planState;		// What this stitch was planned from
 };
\ No newline at end of file
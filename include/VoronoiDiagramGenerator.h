@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <search.h>
+#include <vector>
 
 
 #ifndef NULL
@@ -51,13 +52,6 @@ struct	Freenode
 	struct	Freenode *nextfree;
 };
 
-struct FreeNodeArrayList
-{
-	struct	Freenode* memory;
-	struct	FreeNodeArrayList* next;
-
-};
-
 struct	Freelist
 {
 	struct	Freenode	*head;
@@ -91,7 +85,7 @@ struct Edge
 struct GraphEdge
 {
 	float x1,y1,x2,y2;
-	struct GraphEdge* next;
+	int site1,site2;	// indices of the two sites the edge separates
 };
 
 
@@ -119,30 +113,74 @@ public:
 
 	bool generateVoronoi(float *xValues, float *yValues, int numPoints, float minX, float maxX, float minY, float maxY, float minDist=0);
 
+	// Size the hash tables and the memory pool for diagrams of numSites
+	// sites ahead of time. The tables hold 2 sqrt(n) and 4 sqrt(n) buckets
+	// by default, hashScale scales both.
+	// The pool is kept from one generateVoronoi to the next and only grows,
+	// so a generator reused for diagrams of similar size stops allocating.
+	void reserve(int numSites, float hashScale = 1);
+
+	// Drop the last diagram but keep all memory for the next one.
+	void reset();
+
+	// Give all memory back, reserve and generateVoronoi start over.
+	void releaseMemory();
+
 	void resetIterator()
 	{
-		iteratorEdges = allEdges;
+		iteratorEdges = 0;
 	}
 
 	bool getNext(float& x1, float& y1, float& x2, float& y2)
 	{
-		if(iteratorEdges == 0)
+		if(iteratorEdges >= allEdges.size())
 			return false;
 
-		x1 = iteratorEdges->x1;
-		x2 = iteratorEdges->x2;
-		y1 = iteratorEdges->y1;
-		y2 = iteratorEdges->y2;
+		const GraphEdge& edge = allEdges[iteratorEdges++];
 
-		iteratorEdges = iteratorEdges->next;
+		x1 = edge.x1;
+		x2 = edge.x2;
+		y1 = edge.y1;
+		y2 = edge.y2;
 
 		return true;
 	}
 
+	// same as above, also returns the indices (into xValues/yValues) of the
+	// two sites whose cells meet at this edge
+	bool getNext(float& x1, float& y1, float& x2, float& y2, int& site1, int& site2)
+	{
+		if(iteratorEdges >= allEdges.size())
+			return false;
+
+		site1 = allEdges[iteratorEdges].site1;
+		site2 = allEdges[iteratorEdges].site2;
+
+		return getNext(x1, y1, x2, y2);
+	}
+
+	// all clipped edges of the last diagram, in the order getNext returns them
+	const std::vector<GraphEdge>& getEdges() const
+	{
+		return allEdges;
+	}
+
+	// The cell of every site, clipped to the box given to generateVoronoi,
+	// in compressed row form: the corners of the cell of site i, going
+	// around the site counter clockwise (for y up), are
+	// cellCorners[cellStart[i]] ... cellCorners[cellStart[i + 1] - 1].
+	// Corners of the box are included where they belong to the cell.
+	void getCells(std::vector<int>& cellStart, std::vector<Point>& cellCorners) const;
+
+	// The Delaunay neighbors of every site, i.e. the sites whose cells share
+	// an edge with it (before clipping), in the same form as getCells.
+	void getNeighbors(std::vector<int>& neighborStart, std::vector<int>& neighbors) const;
+
 
 private:
 	void cleanup();
 	void cleanupEdges();
+	void growPool(size_t n);
 	char *getfree(struct Freelist *fl);
 	struct	Halfedge *PQfind();
 	int PQempty();
@@ -195,7 +233,7 @@ private:
 	void out_vertex(struct Site *v);
 	struct Site *nextone();
 
-	void pushGraphEdge(float x1, float y1, float x2, float y2);
+	void pushGraphEdge(float x1, float y1, float x2, float y2, int site1 = -1, int site2 = -1);
 
 	void openpl();
 	void line(float x1, float y1, float x2, float y2);
@@ -231,11 +269,19 @@ private:
 
 	float borderMinX, borderMaxX, borderMinY, borderMaxY;
 
-	FreeNodeArrayList* allMemoryList;
-	FreeNodeArrayList* currentMemoryBlock;
+	// memory pool of the sweep, bumped by myalloc and rewound by cleanup
+	std::vector<char*> poolBlocks;
+	std::vector<size_t> poolSizes;
+	size_t poolBlock, poolUsed;
+
+	float hashScale;
+
+	std::vector<GraphEdge> allEdges;
+	size_t iteratorEdges;
 
-	GraphEdge* allEdges;
-	GraphEdge* iteratorEdges;
+	// what getCells and getNeighbors need once the sweep has freed its sites
+	std::vector<Point> siteCoords;
+	std::vector<int> delaunayEdges;	// pairs of site indices
 
 	float minDistanceBetweenSites;
 
@@ -243,5 +289,13 @@ private:
 
 int scomp(const void *p1,const void *p2);
 
+// scomp for std::sort, by y, then x
+inline bool siteLess(const Site& s1, const Site& s2)
+{
+	if(s1.coord.y != s2.coord.y)
+		return s1.coord.y < s2.coord.y;
+	return s1.coord.x < s2.coord.x;
+}
+
 
 #endif
@@ -22,6 +22,7 @@ public:
 	void RenderFormedTriangles(SDL_Renderer* rend);
 
 	void AddNode(const std::shared_ptr<IntersectionNode>& node);
+	void AddNodes(const std::vector<std::shared_ptr<IntersectionNode>>& nodes);	// Same order as calling AddNode on each, sorting once.
 	bool RemoveNode(int nodeID);
 	void ClearNodes();
 	void FlipPolarity();
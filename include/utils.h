@@ -19,10 +19,17 @@ double genRand(double l, double h);
 class HashVec {
 public:
 
-  float operator() (const vec2& v) const {
+  size_t operator() (const vec2& v) const {
     // using the cantor function!
     // return 0.5 * (v.x + v.y) * (v.x + v.y + 1) + v.y;
-    return 100 * v.x + v.y;
+    // return 100 * v.x + v.y;
+
+    // 100 * x + y collides all the time for jittered points and throws
+    // away the fractional part, so mix the hashes of both components instead
+    size_t hx = std::hash<float>()(v.x);
+    size_t hy = std::hash<float>()(v.y);
+
+    return hx ^ (hy + 0x9e3779b9 + (hx << 6) + (hx >> 2));
   }
 };
 
@@ -0,0 +1,201 @@
+#include "CentroidalVoronoi.h"
+#include "ShardedVoronoi.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+// clip the convex polygon 'in' to the side of the line coord = 'at' given by
+// 'keepBelow', coord 0 is x and 1 is y (one step of Sutherland-Hodgman)
+static void clipPolygon(const std::vector<vec2> &in, std::vector<vec2> &out,
+                        const int coord, const float at, const bool keepBelow) {
+
+  out.clear();
+
+  const int count = in.size();
+
+  for (int i = 0; i < count; ++i) {
+    const vec2 &p = in[i];
+    const vec2 &q = in[(i + 1) % count];
+
+    const bool pin = keepBelow ? p[coord] <= at : p[coord] >= at;
+    const bool qin = keepBelow ? q[coord] <= at : q[coord] >= at;
+
+    if (pin) out.push_back(p);
+
+    if (pin != qin) {
+      float t = (at - p[coord]) / (q[coord] - p[coord]);
+      out.push_back(p + t * (q - p));
+    }
+  }
+}
+
+// area and area times centroid of a polygon (shoelace)
+static void polygonMoments(const std::vector<vec2> &poly, double &area,
+                           double &mx, double &my) {
+
+  area = mx = my = 0.0;
+
+  const int count = poly.size();
+
+  for (int i = 0; i < count; ++i) {
+    const vec2 &p = poly[i];
+    const vec2 &q = poly[(i + 1) % count];
+
+    double cross = (double)p.x * q.y - (double)q.x * p.y;
+    area += cross;
+    mx += (p.x + q.x) * cross;
+    my += (p.y + q.y) * cross;
+  }
+
+  area *= 0.5;
+  mx /= 6.0;
+  my /= 6.0;
+}
+
+// density weighted centroid of the convex polygon 'corners', the density is
+// constant over each pixel, so the polygon is cut into its pieces inside
+// every pixel and their moments are summed exactly
+// cells are about a pixel in size for dense stipples, anything coarser
+// (pixel centres, say) snaps the points to the pixel lattice
+// falls back to the plain centroid if there is no weight inside
+static vec2 cellCentroid(const std::vector<vec2> &corners,
+                         const std::vector<float> &density,
+                         const int width, const int height,
+                         const vec2 &site) {
+
+  if (corners.size() < 3) return site;
+
+  float xlo = corners[0].x, xhi = corners[0].x;
+  float ylo = corners[0].y, yhi = corners[0].y;
+
+  for (const vec2 &c : corners) {
+    xlo = std::min(xlo, c.x); xhi = std::max(xhi, c.x);
+    ylo = std::min(ylo, c.y); yhi = std::max(yhi, c.y);
+  }
+
+  const int h0 = std::max(0, (int)std::floor(ylo));
+  const int h1 = std::min(height - 1, (int)std::floor(yhi));
+  const int w0 = std::max(0, (int)std::floor(xlo));
+  const int w1 = std::min(width - 1, (int)std::floor(xhi));
+
+  double mass = 0.0, mx = 0.0, my = 0.0;
+
+  std::vector<vec2> band, tmp, piece;
+
+  for (int h = h0; h <= h1; ++h) {
+    // the part of the cell in this row of pixels
+    clipPolygon(corners, tmp, 1, h, false);
+    clipPolygon(tmp, band, 1, h + 1, true);
+
+    if (band.size() < 3) continue;
+
+    const float *row = density.data() + h * width;
+
+    for (int w = w0; w <= w1; ++w) {
+      if (row[w] == 0.0f) continue;
+
+      clipPolygon(band, tmp, 0, w, false);
+      clipPolygon(tmp, piece, 0, w + 1, true);
+
+      if (piece.size() < 3) continue;
+
+      double a, ax, ay;
+      polygonMoments(piece, a, ax, ay);
+
+      mass += row[w] * a;
+      mx += row[w] * ax;
+      my += row[w] * ay;
+    }
+  }
+
+  if (mass > 1e-12) return vec2(mx / mass, my / mass);
+
+  double area;
+  polygonMoments(corners, area, mx, my);
+
+  if (std::fabs(area) < 1e-12) return site;
+
+  return vec2(mx / area, my / area);
+}
+
+int centroidalVoronoi(std::vector<vec2> &points,
+                      const std::vector<float> &density,
+                      const int width, const int height,
+                      const CVTParams &params) {
+
+  const int n = points.size();
+
+  if (n == 0) return 0;
+
+  int numThreads = params.numThreads;
+
+  if (numThreads <= 0)
+    numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  numThreads = std::min(numThreads, n);
+
+  std::vector<float> xValues(n), yValues(n);
+
+  // cells of all sites, in compressed row form
+  std::vector<int> cellStart;
+  std::vector<Point> cellCorners;
+
+  std::vector<vec2> next(n);
+  std::vector<float> moved(n);
+
+  // one set of generators for all the iterations, their memory is reused
+  ShardedVoronoi voronoi(numThreads);
+
+  int iter = 0;
+
+  while (iter < params.maxIterations) {
+    ++iter;
+
+    for (int i = 0; i < n; ++i) {
+      xValues[i] = points[i].x;
+      yValues[i] = points[i].y;
+    }
+
+    voronoi.generateCells(xValues.data(), yValues.data(), n,
+                          0, width, 0, height, cellStart, cellCorners);
+
+    // every site on its own, in parallel
+    std::atomic<int> nextSite(0);
+    const int BATCH = 256;
+
+    auto worker = [&]() {
+      std::vector<vec2> corners;
+
+      for (int b = nextSite.fetch_add(BATCH); b < n; b = nextSite.fetch_add(BATCH)) {
+        for (int s = b; s < std::min(b + BATCH, n); ++s) {
+          corners.clear();
+
+          for (int i = cellStart[s]; i < cellStart[s + 1]; ++i)
+            corners.push_back(vec2(cellCorners[i].x, cellCorners[i].y));
+
+          next[s] = cellCentroid(corners, density, width, height, points[s]);
+          moved[s] = glm::length(next[s] - points[s]);
+        }
+      }
+    };
+
+    std::vector<std::thread> pool;
+
+    for (int t = 1; t < numThreads; ++t)
+      pool.push_back(std::thread(worker));
+
+    worker();
+
+    for (auto &t : pool)
+      t.join();
+
+    points.swap(next);
+
+    if (*std::max_element(moved.begin(), moved.end()) < params.tolerance)
+      break;
+  }
+
+  return iter;
+}
@@ -0,0 +1,188 @@
+#include "EulerTourForest.h"
+
+#include <algorithm>
+
+EulerTourForest::EulerTourForest(const int numVertices) :
+numVertices(numVertices), seed(2463534242u)
+{
+  // one single node tour per vertex
+  for (int i = 0; i < numVertices; ++i)
+    newNode();
+}
+
+int EulerTourForest::newNode() {
+
+  // xorshift, the priorities only need to look random to keep the treap flat
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  int t;
+
+  if (!freeNodes.empty()) {
+    t = freeNodes.back();
+    freeNodes.pop_back();
+  }
+  else {
+    t = left.size();
+    left.push_back(-1); right.push_back(-1); parent.push_back(-1);
+    count.push_back(1); priority.push_back(0);
+  }
+
+  left[t] = right[t] = parent[t] = -1;
+  count[t] = 1;
+  priority[t] = seed;
+
+  return t;
+}
+
+void EulerTourForest::freeNode(int t) {
+  freeNodes.push_back(t);
+}
+
+void EulerTourForest::update(int t) {
+  count[t] = 1 + size(left[t]) + size(right[t]);
+}
+
+int EulerTourForest::root(int t) const {
+  while (parent[t] != -1)
+    t = parent[t];
+
+  return t;
+}
+
+int EulerTourForest::position(int t) const {
+
+  int k = size(left[t]);
+
+  // every time we come up from a right child, the parent and its left
+  // subtree are in front of us
+  while (parent[t] != -1) {
+    int p = parent[t];
+
+    if (right[p] == t)
+      k += size(left[p]) + 1;
+
+    t = p;
+  }
+
+  return k;
+}
+
+int EulerTourForest::merge(int a, int b) {
+
+  if (a == -1) return b;
+  if (b == -1) return a;
+
+  if (priority[a] > priority[b]) {
+    right[a] = merge(right[a], b);
+    parent[right[a]] = a;
+    update(a);
+    return a;
+  }
+  else {
+    left[b] = merge(a, left[b]);
+    parent[left[b]] = b;
+    update(b);
+    return b;
+  }
+}
+
+void EulerTourForest::split(int t, int k, int &a, int &b) {
+
+  if (t == -1) {
+    a = b = -1;
+    return;
+  }
+
+  if (size(left[t]) < k) {
+    int r1, r2;
+    split(right[t], k - size(left[t]) - 1, r1, r2);
+
+    right[t] = r1;
+    if (r1 != -1) parent[r1] = t;
+    update(t);
+
+    a = t; b = r2;
+  }
+  else {
+    int l1, l2;
+    split(left[t], k, l1, l2);
+
+    left[t] = l2;
+    if (l2 != -1) parent[l2] = t;
+    update(t);
+
+    a = l1; b = t;
+  }
+
+  // both halves are roots now, the caller attaches them if need be
+  if (a != -1) parent[a] = -1;
+  if (b != -1) parent[b] = -1;
+}
+
+void EulerTourForest::reroot(int v) {
+
+  int a, b;
+  split(root(v), position(v), a, b);
+
+  // tour starting at 'v' = the part from 'v' on + the part before it
+  merge(b, a);
+}
+
+bool EulerTourForest::link(const int u, const int v) {
+
+  if (connected(u, v)) return false;
+
+  reroot(u);
+  reroot(v);
+
+  int uv = newNode();
+  int vu = newNode();
+
+  arcs[key(u, v)] = uv;
+  arcs[key(v, u)] = vu;
+
+  // tour(u) u->v tour(v) v->u
+  merge(merge(merge(root(u), uv), root(v)), vu);
+
+  return true;
+}
+
+bool EulerTourForest::cut(const int u, const int v) {
+
+  auto uvIt = arcs.find(key(u, v));
+  auto vuIt = arcs.find(key(v, u));
+
+  if (uvIt == arcs.end() || vuIt == arcs.end()) return false;
+
+  int first = uvIt->second;
+  int second = vuIt->second;
+
+  arcs.erase(uvIt);
+  arcs.erase(vuIt);
+
+  int p1 = position(first);
+  int p2 = position(second);
+
+  if (p1 > p2) {
+    std::swap(p1, p2);
+    std::swap(first, second);
+  }
+
+  // the tour is A first B second C, where B is the tour of the subtree
+  // hanging off the edge and A C is the tour of the rest
+  int a, b, c, rest, arc;
+
+  split(root(first), p1, a, rest);
+  split(rest, 1, arc, rest);
+  split(rest, p2 - p1 - 1, b, rest);
+  split(rest, 1, arc, c);
+
+  merge(a, c);
+
+  freeNode(first);
+  freeNode(second);
+
+  return true;
+}
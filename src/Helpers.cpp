@@ -266,18 +266,37 @@ void Helpers::LerpColor(const PixelRGB& c1, const PixelRGB& c2, float t, PixelRG
 void Helpers::ComputeBarycentricCoordinates(const Vector2D& p, const Vector2D& a, const Vector2D& b, const Vector2D& c, 
     float& u, float& v, float& w)
 {
-    Vector2D v0 = b - a;
-    Vector2D v1 = c - a;
-    Vector2D v2 = p - a;
-    double den = 1.0f / (v0[0] * v1[1] - v1[0] * v0[1]);
-    v = (v2[0] * v1[1] - v1[0] * v2[1]) * den;
-    w = (v0[0] * v2[1] - v2[0] * v0[1]) * den;
+    // Component wise, as this runs for every pixel of a layer.
+    double v0x = b[0] - a[0], v0y = b[1] - a[1];
+    double v1x = c[0] - a[0], v1y = c[1] - a[1];
+    double v2x = p[0] - a[0], v2y = p[1] - a[1];
+    double den = 1.0f / (v0x * v1y - v1x * v0y);
+    v = (v2x * v1y - v1x * v2y) * den;
+    w = (v0x * v2y - v2x * v0y) * den;
     u = 1.0f - v - w;
 }
 
+float Helpers::PseudoAngle(double x, double y)
+{
+    // Position along the diamond |x| + |y| = 1, one unit per quadrant.
+    double sum = std::abs(x) + std::abs(y);
+    if (sum == 0.0) return 0.0f;
+
+    if (y >= 0.0)
+        return (float)((x >= 0.0) ? y / sum : 1.0 - x / sum);
+
+    return (float)((x < 0.0) ? 2.0 - y / sum : 3.0 + x / sum);
+}
+
 bool Helpers::PointTriangleIntersection(const Vector2D& s, const Vector2D& a, const Vector2D& b, const Vector2D& c)
 {
     float u, v, w;
+    return Helpers::PointTriangleIntersection(s, a, b, c, u, v, w);
+}
+
+bool Helpers::PointTriangleIntersection(const Vector2D& s, const Vector2D& a, const Vector2D& b, const Vector2D& c,
+    float& u, float& v, float& w)
+{
     Helpers::ComputeBarycentricCoordinates(s, a, b, c, u, v, w);
 
     return (u >= -0.013 && v >= -0.013 && w >= -0.013);
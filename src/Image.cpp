@@ -9,23 +9,26 @@
 #include <limits>
 #include <queue>
 #include <utility>
-#include  <random>
 #include  <iterator>
 #include <cmath>
 #include <cfenv>
 #include <climits>
 
 #include "utils.h"
+#include "Random.h"
 
 typedef unsigned char uchar;
 typedef std::int16_t int16;
 
 typedef std::pair<float, vec2> iPair;
 
+// (cost, point id) pairs for the dense id searches
+typedef std::pair<float, int> idPair;
+
 const float INF = std::numeric_limits<float>::max();
 
 Image::Image(int width, int height, int channels) :
-width(width), height(height), channels(channels)
+width(width), height(height), channels(channels), integralValid(0)
 {
     int numbytes = 4 * width * height;  // always use 4 channels
     // allocate space for the pixmap
@@ -39,6 +42,57 @@ width(width), height(height), channels(channels)
         matrix[i] = matrix[i - 1] + 4 * width;
 }
 
+void Image::buildIntegral(int c) {
+
+  if (integralValid & (1 << c)) return;
+
+  const int stride = width + 1;
+  std::vector<uint32_t> &table = integral[c];
+
+  table.assign((height + 1) * stride, 0);
+
+  for (int h = 0; h < height; ++h) {
+    const unsigned char *row = matrix[h] + c;
+    uint32_t rowSum = 0;
+
+    for (int w = 0; w < width; ++w) {
+      rowSum += row[4 * w];
+      table[(h + 1) * stride + w + 1] = table[h * stride + w + 1] + rowSum;
+    }
+  }
+
+  integralValid |= 1 << c;
+}
+
+uint64_t Image::regionSum(int c, int h0, int w0, int h1, int w1) {
+
+  h0 = std::max(h0, 0); w0 = std::max(w0, 0);
+  h1 = std::min(h1, height); w1 = std::min(w1, width);
+
+  if (h0 >= h1 || w0 >= w1) return 0;
+
+  buildIntegral(c);
+
+  const int stride = width + 1;
+  const std::vector<uint32_t> &table = integral[c];
+
+  // unsigned arithmetic wraps the same way the table did
+  uint32_t sum = table[h1 * stride + w1] - table[h0 * stride + w1]
+               - table[h1 * stride + w0] + table[h0 * stride + w0];
+
+  return sum;
+}
+
+float Image::regionMean(int c, int h0, int w0, int h1, int w1) {
+
+  h0 = std::max(h0, 0); w0 = std::max(w0, 0);
+  h1 = std::min(h1, height); w1 = std::min(w1, width);
+
+  if (h0 >= h1 || w0 >= w1) return 0.0f;
+
+  return regionSum(c, h0, w0, h1, w1) / (float)((h1 - h0) * (w1 - w0));
+}
+
 // paint white
 void Image::init(unsigned char b) {
 
@@ -178,6 +232,8 @@ void Image::drawStitches(std::vector<edge> &graph) {
 
 // convert the input image to RGBA format if required
 void Image::copyImage(const unsigned char *pixmap_) {
+    integralValid = 0;
+
     // get the number of bytes to copy
     int numbytes = channels * width * height;
 
@@ -685,10 +741,11 @@ void pushNewNode(std::vector<vec2> &nodes,
 }
 
 // get the edge weight between u and v
+template <typename Cost>
 float weight(vec2 u, vec2 v,
              int width, int height,
              const std::vector<vec2> &normals,
-             float(*cost)(vec2 &, vec2 &, vec2 &)) {
+             Cost cost) {
 
   u.y = std::floor(u.y);
   u.x = std::floor(u.x);
@@ -706,6 +763,35 @@ float weight(vec2 u, vec2 v,
   return cost(u, v, n);
 }
 
+// batched weight(), scores (u, p) for every point p in 'ids' into batch.out
+// the floor, normal lookup and recentering of 'u' happen once for the batch
+template <typename Cost>
+void weights(vec2 u, const std::vector<int> &ids, const PointGrid &grid,
+             int width, int height,
+             const std::vector<vec2> &normals,
+             Cost cost, CostBatch &batch) {
+
+  u.y = std::floor(u.y);
+  u.x = std::floor(u.x);
+
+  // get the corresponding normal at 'u'
+  vec2 n = normals[u.y * width + u.x];
+
+  // convert to diff system
+  u.x -= width/2;
+  u.y = height/2 - u.y;
+
+  batch.resize(ids.size());
+
+  for (size_t i = 0; i < ids.size(); ++i) {
+    const vec2 &v = grid.getPoint(ids[i]);
+    batch.x[i] = v.x - width/2;
+    batch.y[i] = height/2 - v.y;
+  }
+
+  evalCosts(cost, u, n, batch);
+}
+
 // find the first edge that exceeds the given threshold
 int findLongEdge(std::vector<edge> &graph, const float threshold) {
 
@@ -1031,9 +1117,10 @@ std::vector<edge> Image::clipJumps(const std::vector<vec2> &normals,
 }
 
 // return all the bad stitches
+template <typename Cost>
 std::vector<edge> Image::findJumps(const std::vector<vec2> &normals,
                                    const std::vector<edge> &graph,
-                                   float(*cost)(vec2 &, vec2 &, vec2 &)) {
+                                   Cost cost) {
 
    std::vector<edge> jumps;
 
@@ -1079,12 +1166,14 @@ void Image::convertToAdj(std::unordered_map<vec2, std::list<vec2>, HashVec> &adj
 // search for the best node from index [start...end]
 // where end is just the last index of the nodes array
 // width = width of the image
+template <typename Cost>
 void pushNode(std::vector<vec2> &nodes,
               std::vector<vec2> &normals,
               int start,
               int width,
               int height,
-              float(*cost)(vec2&, vec2&, vec2 &)) {
+              Cost cost,
+              CostBatch &batch) {
 
     // get the start node
     vec2 u = nodes[start];
@@ -1099,17 +1188,22 @@ void pushNode(std::vector<vec2> &nodes,
     u.x -= width/2;
     u.y = height/2 - u.y;
 
+    // score all the remaining nodes, potential candidates, in one go
+    batch.resize(nodes.size() - start - 1);
+
+    for (int i = start + 1; i < nodes.size(); ++i) {
+        batch.x[i - start - 1] = nodes[i].x - width/2;
+        batch.y[i - start - 1] = height/2 - nodes[i].y;
+    }
+
+    evalCosts(cost, u, n, batch);
+
     float smallest = std::numeric_limits<float>::max();
     int nodeIndex = -1;  // index of the best node
 
     for (int i = start + 1; i < nodes.size(); ++i) {
-        // next node, potential candidate
-        vec2 v = nodes[i];
-        v.x -= width/2;
-        v.y = height/2 - v.y;
-
-        // compute cost and compare
-        float val = cost(u, v, n);
+        // compare
+        float val = batch.out[i - start - 1];
 
         if (val <= smallest) {
           // update
@@ -1123,10 +1217,11 @@ void pushNode(std::vector<vec2> &nodes,
 }
 
 // new stitch plan approach
+template <typename Cost>
 void Image::plan(std::vector<edge> &graph,
                  std::vector<vec2> &nodes,
                  std::vector<vec2> &normals,
-                 float(*cost)(vec2 &, vec2 &, vec2 &)) {
+                 Cost cost) {
 
  /*
  // store all the computed edges of the graph into a vector
@@ -1145,11 +1240,14 @@ void Image::plan(std::vector<edge> &graph,
  */
 
  // shuffle nodes
- std::random_shuffle(nodes.begin(), nodes.end());
+ shuffleRandomly(nodes.begin(), nodes.end());
+
+ // scratch space for the costs, reused for every node
+ CostBatch batch;
 
  // re-arrange the nodes to get the desired order of edges
  for (int i = 0; i < nodes.size() - 1; ++i)
-    pushNode(nodes, normals, i, width, height, cost);
+    pushNode(nodes, normals, i, width, height, cost, batch);
 
  // store all the edges of the graph
  for (int i = 0; i < nodes.size() - 1; ++i) {
@@ -1173,12 +1271,19 @@ void Image::replace() {
 std::vector<vec2> Image::genPoints(std::vector<unsigned char> &densityPoints,
 const int SUBGRID_SIZE) {
 
+  return genPoints(densityPoints, SUBGRID_SIZE, 0, 0, height / SUBGRID_SIZE,
+                   width / SUBGRID_SIZE);
+}
+
+std::vector<vec2> Image::genPoints(std::vector<unsigned char> &densityPoints,
+const int SUBGRID_SIZE, const int h0, const int w0, const int h1, const int w1) {
+
   std::vector<vec2> points;
 
   // iterate over the outer 10 X 10 grid, in the case where we have a
-  // 100 X 100 image
-  for (int h = 0; h < height / SUBGRID_SIZE; ++h) {
-    for (int w = 0; w < width / SUBGRID_SIZE; ++w) {
+  // 100 X 100 image, blocks past the edge of the map have no points
+  for (int h = std::max(h0, 0); h < std::min(h1, height / SUBGRID_SIZE); ++h) {
+    for (int w = std::max(w0, 0); w < std::min(w1, width / SUBGRID_SIZE); ++w) {
 
       // iterate over the actual region/patch
 
@@ -1189,18 +1294,9 @@ const int SUBGRID_SIZE) {
       // compute avg intensity of the pixels in this region
       // to find out how to subdivide the region
 
-      float totalIntensity = 0.0;
-
-      for (int hi = oh; hi < oh + SUBGRID_SIZE; ++hi) {
-        for (int wi = ow; wi < ow + SUBGRID_SIZE; ++wi) {
-          // count
-          pixel current = getpixel(hi, wi);
-          //totalIntensity += current.r;
-          totalIntensity += (current.r / 2) + 128;
-        }
-      }
-
-      totalIntensity /= (SUBGRID_SIZE * SUBGRID_SIZE);
+      // halve the average red rather than every pixel, it is a table lookup
+      float totalIntensity = regionMean(0, oh, ow, oh + SUBGRID_SIZE,
+                                        ow + SUBGRID_SIZE) / 2 + 128;
 
       // if (totalIntensity > 230) continue;
 
@@ -1243,67 +1339,47 @@ const int SUBGRID_SIZE) {
   return points;
 }
 
-std::vector<vec2> Image::generateNeighbors(
+void Image::generateNeighbors(
   const vec2 &current,
-  std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-  const std::unordered_set<vec2, HashVec> &visited,
+  const PointGrid &grid,
+  const std::vector<bool> &visited,
   const float radius,
-  const int BUCKET_SIZE,
-  const std::vector<edge> &segments
+  const std::vector<edge> &segments,
+  std::vector<int> &neighbors
 ) {
 
-  std::vector<vec2> neighbors;
+  // all points in the radius, skipping 'current' itself and anything
+  // closer than a unit
+  grid.query(current, radius, neighbors, 1.0f);
 
-  // find out the bucket 'current' is part of and search in its neighborhood
-
-  // get bin co-ordinates
-  float x = std::floor(current.x / (float)BUCKET_SIZE);
-  float y = std::floor(current.y / (float)BUCKET_SIZE);
-
-  // generate bin indices to get vertices in the neighborhood of 'bin'
-  // the neighborhood is just 3X3 around the 'current' vertex
-  for (int w = x - 1; w <= x + 1; ++w) {
-    for (int h = y - 1; h <= y + 1; ++h) {
-      // get the current bin index and check validity
-      vec2 bin(w, h);
-
-      if (buckets.find(bin) == buckets.end()) continue;
-
-      // scan all nodes
-      for (auto& vertex : buckets[bin]) {
-        // check if node is within the radius
-        if (current != vertex &&
-            visited.find(vertex) == visited.end() &&
-            glm::length(current - vertex) <= radius &&
-            glm::length(current - vertex) >= 1.0)
-          neighbors.push_back(vertex);
-      }
-    }
-  }
+  // filter in place: drop visited nodes and (current, neighbor) pairs that
+  // intersect with any of the given segments
+  size_t kept = 0;
+
+  for (size_t i = 0; i < neighbors.size(); ++i) {
+    int id = neighbors[i];
 
-  std::vector<vec2> nn;
+    if (!visited.empty() && visited[id]) continue;
 
-  // filter out (current, neighbors[i]) if it intersects with the given segment
-  for (int i = 0; i < neighbors.size(); ++i) {
     // test for every segment
     bool doesIntersect = false;
 
     for (auto& segment : segments) {
-      if (doIntersect(segment.u, segment.v, current, neighbors[i])) {
+      if (doIntersect(segment.u, segment.v, current, grid.getPoint(id))) {
         doesIntersect = true;
         break;
       }
     }
-    if (!doesIntersect) nn.push_back(neighbors[i]);
+
+    if (!doesIntersect) neighbors[kept++] = id;
   }
 
-  return nn;
+  neighbors.resize(kept);
 }
 
 std::unordered_map<vec2, std::vector<vec2>, HashVec> Image::genGraph(
   const vec2 &start,
-  std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-  const int BUCKET_SIZE,
+  const PointGrid &grid,
   const std::vector<vec2> &normals,
   float(*cost)(vec2 &, vec2 &, vec2 &)
 ) {
@@ -1327,6 +1403,9 @@ std::unordered_map<vec2, std::vector<vec2>, HashVec> Image::genGraph(
   // radius of neighborhood
   const float radius = 5.0;
 
+  // neighbor ids, reused across iterations
+  std::vector<int> neighbors;
+
   while (!key.empty()) {
 
     // get the best vertex quickly!
@@ -1338,10 +1417,11 @@ std::unordered_map<vec2, std::vector<vec2>, HashVec> Image::genGraph(
 
     // explore neighbors around this vertex
     // these are neighbors of current
-    for (auto& neighbor : generateNeighbors(current, buckets,
-                                            std::unordered_set<vec2, HashVec>{},
-                                            radius, BUCKET_SIZE,
-                                            segments)) {
+    generateNeighbors(current, grid, std::vector<bool>{}, radius, segments,
+                      neighbors);
+
+    for (int id : neighbors) {
+      vec2 neighbor = grid.getPoint(id);
 
       // get the cost of the neighbor from current
       float w = weight(current, neighbor, width, height, normals, cost);
@@ -1506,9 +1586,18 @@ std::vector<vec2> Image::interpretNormalMap() {
 
         vec2 n(rm, rg);
 
+        // find the co-efficient of perturbation based on the blue channel
+        // float c = (float)(b - 128.0) / 128.0;
+        float c = 0.0;
+
         // generate a random vector!
-        float theta = genRand(0.0, 2.0 * PI);
-        vec2 p(cos(theta), sin(theta));
+        // only if it is going to be used, c is 0 for now
+        vec2 p(0.0, 0.0);
+
+        if (c != 0.0) {
+          float theta = genRand(0.0, 2.0 * PI);
+          p = vec2(cos(theta), sin(theta));
+        }
 
         /*
         if (b == 255) {
@@ -1517,10 +1606,6 @@ std::vector<vec2> Image::interpretNormalMap() {
           n.x = n.y = 0.0;
         }
         */
-       
-        // find the co-efficient of perturbation based on the blue channel
-        // float c = (float)(b - 128.0) / 128.0;
-        float c = 0.0;
 
         if (n.x == 0.0 && n.y == 0.0)
           normals.push_back(n);
@@ -1638,18 +1723,11 @@ void Image::flagOff(std::vector<bool> &isoff,
 }
 
 // some helper routines to pick random elements from containers
-template<typename Iter, typename RandomGenerator>
-Iter select_randomly(Iter start, Iter end, RandomGenerator& g) {
-    std::uniform_int_distribution<> dis(0, std::distance(start, end) - 1);
-    std::advance(start, dis(g));
-    return start;
-}
-
 template<typename Iter>
 Iter select_randomly(Iter start, Iter end) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    return select_randomly(start, end, gen);
+    // this thread's generator, planner runs may go in parallel
+    std::advance(start, randomBelow(std::distance(start, end)));
+    return start;
 }
 
 void Image::reverseNormalMap(std::unordered_map<vec2, std::list<vec2>, HashVec> &adj,
@@ -2118,70 +2196,83 @@ void preorder(vec2 &current,
 // no back edges, yayyy!!
 // just having a parent for that node will suffice
 // will also help in making zig-zags while backtracking
-void Image::genPathUtil(vec2 current, vec2 parent,
-std::unordered_map<vec2, std::list<vec2>, HashVec> &adj,
-std::unordered_map<vec2, unsigned char, HashVec> &densities,
-std::vector<vec2> &path) {
-
-  // neighbor
-  std::list<vec2> neighbors = adj[current];
-
-  std::list<vec2>::iterator it;
-
-  for (it = neighbors.begin(); it != neighbors.end(); ++it) {
-    vec2 neighbor = *it;
-
-    if (neighbor != parent) {
-      // make zig-zag from current to neighbor
-      std::vector<vec2> z = zigZag(current, neighbor, densities[current],
-                                   densities[neighbor], 1.2, -1);
-      // concat to the path
-      // path.insert(path.end(), z.begin(), z.end());
-      path.push_back(current);
-      path.push_back(neighbor);
-
-      // recurse
-      genPathUtil(neighbor, current, adj, densities, path);
-    }
-  }
-
-  // check if we are at the start node
-  if (parent != vec2(-1, -1)) {
-    // make a zig-zag in reverse now
-    std::vector<vec2> z = zigZag(current, parent, densities[current],
-                                 densities[parent], 1.2);
-    // concat
-    // path.insert(path.end(), z.begin(), z.end());
-    path.push_back(current);
-    path.push_back(parent);
-  }
-}
-
 void Image::genPath(std::unordered_map<vec2, std::list<vec2>, HashVec> &adj,
                     std::unordered_map<vec2, unsigned char, HashVec> &densities,
-                    std::vector<vec2> &path) {
+                    std::vector<vec2> &path,
+                    const bool zigzags) {
+
+  if (adj.empty()) return;
 
   // select a random start for the traversal
   vec2 start = std::next(std::begin(adj), genRand(0, adj.size() - 1))->first;
 
-  genPathUtil(start, vec2(-1, -1), adj, densities, path);
-}
+  // every tree edge is walked down and back up, two points each way
+  size_t numEnds = 0;
+
+  for (auto& e : adj)
+    numEnds += e.second.size();
+
+  path.reserve(path.size() + 2 * numEnds);
 
-// add stitch (u, v) to an appropriate bucket in stitch buckets
-void addToBucket(const vec2 &u, const vec2 &v,
-std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets) {
+  // density at 'v', unknown points count as 0
+  auto density = [&densities](const vec2 &v) -> unsigned char {
+    auto it = densities.find(v);
+    return it == densities.end() ? 0 : it->second;
+  };
+
+  // add the stitch (u, v) to the path, zig-zagged if asked for
+  auto emit = [&](const vec2 &u, const vec2 &v, const float direction) {
+    if (zigzags) {
+      std::vector<vec2> z = zigZag(u, v, density(u), density(v), 1.2, direction);
+      path.insert(path.end(), z.begin(), z.end());
+    }
+    else {
+      path.push_back(u);
+      path.push_back(v);
+    }
+  };
 
-  const int SUBREGION_SIZE = 5;
+  // explicit stack instead of recursion, deep trees overflowed the call
+  // stack; a frame remembers where it is in its neighbor list
+  struct Frame {
+    vec2 current, parent;
+    std::list<vec2>::const_iterator next, end;
+  };
 
-  // use the mid-point of (u, v) to find an appropriate bucket
-  vec2 m = 0.5f * (u + v);
+  const vec2 noParent(-1, -1);
 
-  // get bin co-ordinates
-  float x = std::floor(m.x / (float)SUBREGION_SIZE);
-  float y = std::floor(m.y / (float)SUBREGION_SIZE);
+  std::vector<Frame> stack;
+  stack.reserve(adj.size());
 
-  // add
-  stitchBuckets[vec2(x, y)].push_back(edge(u, v));
+  const std::list<vec2> &startNeighbors = adj[start];
+  stack.push_back({start, noParent, startNeighbors.begin(), startNeighbors.end()});
+
+  while (!stack.empty()) {
+    Frame &frame = stack.back();
+
+    // skip the way back up
+    while (frame.next != frame.end && *frame.next == frame.parent)
+      ++frame.next;
+
+    if (frame.next != frame.end) {
+      // go down to the next child
+      vec2 current = frame.current;
+      vec2 neighbor = *frame.next++;
+
+      emit(current, neighbor, -1);
+
+      const std::list<vec2> &neighbors = adj[neighbor];
+      stack.push_back({neighbor, current, neighbors.begin(), neighbors.end()});
+    }
+    else {
+      // all children done, back up to the parent
+      // check if we are at the start node
+      if (frame.parent != noParent)
+        emit(frame.current, frame.parent, 1);
+
+      stack.pop_back();
+    }
+  }
 }
 
 // check if e1 and e2 are too close or not
@@ -2249,148 +2340,181 @@ bool isTooCloseToStitch(const edge& e1, const edge& e2, const float distance) {
 
 // is (u, v) too close to any of its neighboring stitches?
 bool isTooClose(const vec2& u, const vec2& v, const float distance,
-std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets) {
-
-  const int SUBREGION_SIZE = 5;
-
-  // use the mid-point of (u, v) to get to the appropriate bucket
-  vec2 m = 0.5f * (u + v);
-
-  // get bin co-ordinates
-  float x = std::floor(m.x / (float)SUBREGION_SIZE);
-  float y = std::floor(m.y / (float)SUBREGION_SIZE);
-
-  // get all the nearby stitches of (u, v)
-  std::vector<edge> stitches = stitchBuckets[vec2(x, y)];
+const StitchGrid &stitchGrid) {
 
-  // check if (u, v) maintains a distance 'distance' from each and every
-  // one of these stitches
-  for (auto& stitch : stitches) {
-    if (doIntersect(u, v, stitch.u, stitch.v))
-      return true;
-  }
-
-  return false;
+  // check if (u, v) crosses any of the stitches in the cells it passes through
+  return stitchGrid.crosses(u, v);
 }
 
 std::vector<vec2> filterNeighbors(const vec2& current,
 const std::vector<vec2> &neighbors,
 const float distance,
-std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets
+const StitchGrid &stitchGrid
 ) {
 
   std::vector<vec2> goodNeighbors;
 
   for (const auto &neighbor : neighbors) {
     // check if neighbor is good enough or not
-    if ( !isTooClose(current, neighbor, distance, stitchBuckets) )
+    if ( !isTooClose(current, neighbor, distance, stitchGrid) )
       goodNeighbors.push_back(neighbor);
   }
 
   return goodNeighbors;
 }
 
+template <typename Cost1, typename Cost2>
+std::vector<edge> Image::dijkstra(
+    const int start,
+    const PointGrid& grid,
+    StitchGrid& stitchGrid,
+    const std::vector<vec2>& normals,
+    Cost1 cost1,
+    Cost2 cost2,
+const std::vector<edge>& segments
+) {
+
+   return dijkstra(std::vector<int>(1, start), std::vector<bool>(), grid,
+                   stitchGrid, normals, cost1, cost2, segments);
+}
+
+template <typename Cost1, typename Cost2>
 std::vector<edge> Image::dijkstra(
-    const vec2& start,
-    std::unordered_map<vec2, std::vector<vec2>, HashVec>& buckets,
-    std::unordered_map<vec2, std::vector<edge>, HashVec>& stitchBuckets,
-    const int BUCKET_SIZE,
+    const std::vector<int>& starts,
+    const std::vector<bool>& open,
+    const PointGrid& grid,
+    StitchGrid& stitchGrid,
     const std::vector<vec2>& normals,
-    float(*cost1)(vec2&, vec2&, vec2&),
-    float(*cost2)(vec2&, vec2&, vec2&),
+    Cost1 cost1,
+    Cost2 cost2,
 const std::vector<edge>& segments
 ) {
 
    // store edges, return at the end
    std::vector<edge> edges;
 
+   const std::vector<vec2>& points = grid.getPoints();
+   const int numPoints = points.size();
+
    // priority queue!
-   std::priority_queue<VecPair, std::vector<VecPair>, VecComparator> pq;
+   std::priority_queue<idPair, std::vector<idPair>, std::greater<idPair>> pq;
 
-   // distances from source to all other vertices
-   std::unordered_map<vec2, float, HashVec> distance;
+   // distances from source to all other vertices, indexed by point id
+   std::vector<float> distance(numPoints, INF);
 
-   // maintain parents to make the edges
-   std::unordered_map<vec2, vec2, HashVec> parent;
+   // maintain parents to make the edges, -1 = no parent
+   std::vector<int> parent(numPoints, -1);
 
    // maintain all visited
    // need to do this since we have negative edge weights, yikes!
-   std::unordered_set<vec2, HashVec> visited;
+   // points the tree may not grow into count as visited from the start
+   std::vector<bool> visited(numPoints, false);
+
+   if (!open.empty())
+     for (int i = 0; i < numPoints; ++i)
+       visited[i] = !open[i];
 
    // a rough distance between 2 stitches
    const float threshold = 1.0;
 
-   // push source into queue
-   pq.push(VecPair(start, 0));
-   distance.insert({start, 0.0});
-
    const float radius = 5.0;
 
-   // iterate until not empty
-   while (!pq.empty()) {
-     // get the current best vertex from the source
-     VecPair currentPair = pq.top();
-     pq.pop();
-
-     vec2 current = currentPair.vertex;
+   // neighbor ids and their costs, reused across iterations
+   std::vector<int> neighbors;
+   CostBatch batch1, batch2;
 
-     if (current != start) {
-       // has to have a parent, this will the parent of current in the SPT
-       vec2 p = parent[current];
-       addToBucket(current, parent[current], stitchBuckets); // add this stitch to the appropriate bucket
-     }
-
-     // add to visited
-     visited.insert(current);
+   // relax the neighbors of a vertex that was just settled
+   auto expand = [&](const int cur) {
+     vec2 current = points[cur];
 
-     std::vector<vec2> neighbors = generateNeighbors(current, buckets, visited,
-                                                     radius, BUCKET_SIZE,
-                                                     segments);
+     generateNeighbors(current, grid, visited, radius, segments, neighbors);
 
      /*
      std::vector<vec2> gneighbors = filterNeighbors(current, neighbors,
-                                                    threshold, stitchBuckets);
+                                                    threshold, stitchGrid);
      */
 
+     // lookup weighting parameter from the normal map
+     pixel pix = getpixel(std::floor(current.y), std::floor(current.x));
+     float c = (float)(pix.b - 128.0) / 128.0;
+     c = 1;
+
+     // compute weights of all the (current, neighbor) edges in one go
+     // w1 carries no weight when c = 1, skip it then
+     if (c != 1)
+       weights(current, neighbors, grid, width, height, normals, cost1, batch1);
+
+     // the sources have no stitch to turn from
+     if (parent[cur] != -1) {
+       batch2.resize(neighbors.size());
+
+       for (size_t i = 0; i < neighbors.size(); ++i) {
+         batch2.x[i] = points[neighbors[i]].x;
+         batch2.y[i] = points[neighbors[i]].y;
+       }
+
+       evalTurnCosts(cost2, points[parent[cur]], current, batch2);
+     }
+
      // filter based on proximity to other stitches
      // generate neighbors for the current vertex
-     for (auto& neighbor : neighbors) {
-
-       // float w = weight(current, neighbor, width, height, normals, cost1);
+     for (size_t i = 0; i < neighbors.size(); ++i) {
 
-       // compute weight of the (current, neighbor) edge
-       float w1 = weight(current, neighbor, width, height, normals, cost1);
-       // check if current is not equal to start
-       float w2 = 0;
+       int n = neighbors[i];
 
-       if (current != start)
-         w2 = cost2(parent[current], current, neighbor);
+       float w1 = c != 1 ? batch1.out[i] : 0;
+       float w2 = parent[cur] != -1 ? batch2.out[i] : 0;
 
-       // lookup weighting parameter from the normal map
-       pixel pix = getpixel(std::floor(current.y), std::floor(current.x));
-       float c = (float)(pix.b - 128.0) / 128.0;
-       c = 1;
        // compute final weight
        float w = (1 - c) * w1 + c * w2;
        // float w = std::max((1-c)*w1, c*w2);
 
        // update distance if need be
-       if (distance.find(neighbor) == distance.end() ||
-           distance[neighbor] > distance[current] + w) {
-         // update! the first condition implies distance of infinity
-         distance[neighbor] = distance[current] + w;
+       // an unseen vertex has a distance of infinity
+       if (distance[n] > distance[cur] + w) {
+         // update!
+         distance[n] = distance[cur] + w;
          // update pq
-         pq.push(VecPair(neighbor, distance[neighbor]));
+         pq.push(idPair(distance[n], n));
          // also update the parent
-         parent[neighbor] = current;
+         parent[n] = cur;
        }
      }
+   };
+
+   // the sources are settled first, all at a distance of 0
+   for (int start : starts) {
+     distance[start] = 0.0;
+     visited[start] = true;
    }
 
-   // iterate over all key-value pairs in the parent to form the edges
-   for (auto& it : parent) {
-     // generate edge and add
-     edges.push_back(edge(it.first, it.second));
+   for (int start : starts)
+     expand(start);
+
+   // iterate until not empty
+   while (!pq.empty()) {
+     // get the current best vertex from the source
+     idPair currentPair = pq.top();
+     pq.pop();
+
+     int cur = currentPair.second;
+
+     // stale entry, this vertex was already settled with a better cost
+     if (visited[cur]) continue;
+
+     // has to have a parent, this will the parent of current in the SPT
+     stitchGrid.add(points[cur], points[parent[cur]]); // add this stitch to the stitch grid
+
+     // add to visited
+     visited[cur] = true;
+
+     expand(cur);
+   }
+
+   // every vertex with a parent contributes one edge of the SPT
+   for (int i = 0; i < numPoints; ++i) {
+     if (parent[i] != -1)
+       edges.push_back(edge(points[i], points[parent[i]]));
    }
 
    return edges;
@@ -2420,85 +2544,69 @@ void addEdge(
 // return value is false
 bool isCollisionFree(const vec2& u, const vec2& v,
 vec2& eu, vec2& ev,
-std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets) {
-
-  const int SUBREGION_SIZE = 5;
+const StitchGrid &stitchGrid) {
 
-  // use the mid-point of (u, v) to get to the appropriate bucket
-  vec2 m = 0.5f * (u + v);
+  // look for a stitch crossing (u, v) in the cells (u, v) passes through
+  int id = stitchGrid.findCrossing(u, v);
 
-  // get bin co-ordinates
-  float x = std::floor(m.x / (float)SUBREGION_SIZE);
-  float y = std::floor(m.y / (float)SUBREGION_SIZE);
-
-  // get all the nearby stitches of (u, v)
-  std::vector<edge> stitches = stitchBuckets[vec2(x, y)];
-
-  // check if (u, v) maintains a distance 'distance' from each and every
-  // one of these stitches
-  for (auto& stitch : stitches) {
-    if (doIntersect(u, v, stitch.u, stitch.v)) {
-      eu = stitch.u; ev = stitch.v;
-      return false;
-    }
+  if (id != -1) {
+    eu = stitchGrid.getStitch(id).u; ev = stitchGrid.getStitch(id).v;
+    return false;
   }
 
   // not too close to any stitch
   return true;
 }
 
-// do not pick neighbors in 'groupNumber'
-// 'v' belongs to the 'groupNumber' connected component
-// we want to pick neighbors from the other group
+// do not pick neighbors in the tree of 'v'
+// cleanup has just cut the tree 'v' was in in two
+// we want to pick neighbors from the other part (or from no tree at all)
 // and then evaluate each of their fitnesses to get the best
-vec2 Image::getBestNode(const vec2 &v,
+template <typename Cost>
+vec2 Image::getBestNode(const int v,
 const std::vector<vec2> &normals,
-float(*cost)(vec2 &, vec2 &, vec2 &),
-std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets,
-std::unordered_map<vec2, int, HashVec> group,
+Cost cost,
+const PointGrid &grid,
+StitchGrid &stitchGrid,
+const EulerTourForest &forest,
+const std::vector<int> &vertex,
 const float radius,
-const int BUCKET_SIZE,
 float &bestCost,
-int groupNumber,
 std::vector<edge> &segments
 ) {
 
-  std::vector<vec2> n = generateNeighbors(v, buckets,
-                                          std::unordered_set<vec2, HashVec>{},
-                                          radius, BUCKET_SIZE,
-                                          segments);
+  const vec2 &p = grid.getPoint(v);
 
-  // filter out all neighbors which are in the same group
-  std::vector<vec2> groupNeighbors;
+  std::vector<int> n;
+  generateNeighbors(p, grid, std::vector<bool>{}, radius, segments, n);
 
-  for (const auto &g : n) {
-    if (group[g] != groupNumber)
-      groupNeighbors.push_back(g);
+  // filter out all neighbors which are in the same tree
+  size_t kept = 0;
+
+  for (size_t i = 0; i < n.size(); ++i) {
+    if (!forest.connected(vertex[n[i]], vertex[v]))
+      n[kept++] = n[i];
   }
 
-  // filter out all neighbors that are not collision free
-  // (v, n[i]) are the edge pairs
-  std::vector<vec2> neighbors;
+  n.resize(kept);
 
-  for (const auto &g : groupNeighbors) {
-    vec2 p, q;  // formality
-    if (isCollisionFree(v, g, p, q, stitchBuckets))
-      neighbors.push_back(g);
-  }
+  // filter out all neighbors that are not collision free
+  // (v, n[i]) are the edge pairs, tested as one batch
+  stitchGrid.filterCrossing(p, grid, n);
 
   // find the lowest cost neighbor and return
   float minVal = std::numeric_limits<float>::max();
   vec2 bestVertex(-1, -1);
 
-  for (int i = 0; i < neighbors.size(); ++i) {
-    vec2 neighbor = neighbors[i];
+  CostBatch batch;
+  weights(p, n, grid, width, height, normals, cost, batch);
 
-    float w = weight(v, neighbor, width, height, normals, cost);
+  for (int i = 0; i < n.size(); ++i) {
+    float w = batch.out[i];
 
     if (w < minVal) {
       minVal = w;
-      bestVertex = neighbor;
+      bestVertex = grid.getPoint(n[i]);
     }
   }
 
@@ -2508,56 +2616,118 @@ std::vector<edge> &segments
   return bestVertex;
 }
 
-// dfs to find out the connected components for all reachable nodes
-void dfs(vec2 &v,
-std::unordered_map<vec2, std::list<vec2>, HashVec> &spt,
-std::unordered_map<vec2, int, HashVec> &group,
-int groupNumber
-) {
-
-  // set to visited
-  group[v] = groupNumber;
-
-  std::list<vec2> neighbors = spt[v];
-
-  std::list<vec2>::iterator it;
+// a more adv clip jumps procedure
+// return the adj list of the new cleaned up graph
+template <typename Cost>
+std::unordered_map<vec2, std::list<vec2>, HashVec> Image::cleanup(
+  const std::vector<vec2> &normals,
+  const std::vector<edge> &graph,
+  Cost cost,
+  const PointGrid &grid,
+  StitchGrid &stitchGrid,
+  std::vector<edge> &segments) {
 
-  // iterate over all neighbors
-  for (it = neighbors.begin(); it != neighbors.end(); ++it) {
+  return cleanup(normals, graph, graph, cost, grid, stitchGrid, segments);
+}
 
-    vec2 neighbor = *it;
+// root of 'i' in the union-find 'root', halving the path on the way
+static int findRoot(std::vector<int> &root, int i) {
 
-    // recurse only if not visited
-    if (group.find(neighbor) == group.end())
-      dfs(neighbor, spt, group, groupNumber);
+  while (root[i] != i) {
+    root[i] = root[root[i]];
+    i = root[i];
   }
+
+  return i;
 }
 
-// a more adv clip jumps procedure
-// return the adj list of the new cleaned up graph
+template <typename Cost>
 std::unordered_map<vec2, std::list<vec2>, HashVec> Image::cleanup(
   const std::vector<vec2> &normals,
   const std::vector<edge> &graph,
-  float(*cost)(vec2 &, vec2 &, vec2 &),
-  std::unordered_map<vec2, std::vector<vec2>, HashVec> &buckets,
-  std::unordered_map<vec2, std::vector<edge>, HashVec> &stitchBuckets,
-  const int BUCKET_SIZE,
+  const std::vector<edge> &repair,
+  Cost cost,
+  const PointGrid &grid,
+  StitchGrid &stitchGrid,
   std::vector<edge> &segments) {
 
   // 1.) find all bad stitches
-  std::vector<edge> bads = findJumps(normals, graph, cost);
+  std::vector<edge> bads = findJumps(normals, repair, cost);
   // std::vector<edge> bads = graph;
 
+  // ids of the points, the forest works on those
+  std::unordered_map<vec2, int, HashVec> ids;
+
+  for (int i = 0; i < grid.size(); ++i)
+    ids[grid.getPoint(i)] = i;
+
   // generate adj list from all edges in the graph
   std::unordered_map<vec2, std::list<vec2>, HashVec> spt;
 
-  // undirected graph
   for (int i = 0; i < graph.size(); ++i) {
     edge e = graph[i];
     spt[e.u].push_back(e.v);
     spt[e.v].push_back(e.u);
   }
 
+  // the same edges as a forest, to tell the two sides of a removed edge
+  // apart without walking the whole tree
+  // only the ends of bad stitches are ever cut off, every part of a tree
+  // between them is merged into a single vertex up front: that is still a
+  // forest with the same points connected, and far fewer links to make
+  const int numPoints = grid.size();
+
+  std::vector<char> own(numPoints, 0);
+
+  for (const edge &e : bads) {
+    auto eu = ids.find(e.u);
+    auto ev = ids.find(e.v);
+
+    if (eu != ids.end()) own[eu->second] = 1;
+    if (ev != ids.end()) own[ev->second] = 1;
+  }
+
+  std::vector<int> root(numPoints);
+
+  for (int i = 0; i < numPoints; ++i)
+    root[i] = i;
+
+  for (const edge &e : graph) {
+    const int u = ids[e.u], v = ids[e.v];
+
+    if (!own[u] && !own[v])
+      root[findRoot(root, u)] = findRoot(root, v);
+  }
+
+  // forest vertex of every point
+  std::vector<int> vertex(numPoints, -1);
+  int numVertices = 0;
+
+  for (int i = 0; i < numPoints; ++i) {
+    if (own[i]) {
+      vertex[i] = numVertices++;
+      continue;
+    }
+
+    // the root stands in for its whole part
+    const int r = findRoot(root, i);
+
+    if (vertex[r] == -1)
+      vertex[r] = numVertices++;
+
+    vertex[i] = vertex[r];
+  }
+
+  EulerTourForest forest(numVertices);
+
+  // undirected graph
+  for (const edge &e : graph) {
+    const int u = ids[e.u], v = ids[e.v];
+
+    if (own[u] || own[v])
+      forest.link(vertex[u], vertex[v]);
+  }
+
   const float radius = 7.0;
 
   // 2.) fix them...
@@ -2566,24 +2736,25 @@ std::unordered_map<vec2, std::list<vec2>, HashVec> Image::cleanup(
   for (int i = 0; i < bads.size(); ++i) {
     edge e = bads[i];
 
-    // remove (e.u, e.v)
-    removeEdge(e, spt);
+    auto eu = ids.find(e.u);
+    auto ev = ids.find(e.v);
+
+    if (eu == ids.end() || ev == ids.end()) continue;
 
-    // group 2 connected components created by the removal of (u, v)
-    std::unordered_map<vec2, int, HashVec> group;
+    // remove (e.u, e.v), which cuts its tree in two
+    // nothing to fix if the edge is not in the tree (anymore)
+    if (!forest.cut(vertex[eu->second], vertex[ev->second])) continue;
 
-    // group will also act as the visited set
-    dfs(e.u, spt, group, 1); // label = 1
-    dfs(e.v, spt, group, 2); // label = 2
+    removeEdge(e, spt);
 
-    // best costs of nodes from 1 and 2
+    // best costs of nodes from the side of 'v' and the side of 'u'
     float c1, c2;
-    // choose best node for 'u' from 2
-    vec2 ub = getBestNode(e.u, normals, cost, buckets, stitchBuckets,
-                          group, radius, BUCKET_SIZE, c1, 1, segments);
-    // choose best node for 'v' from 1
-    vec2 vb = getBestNode(e.v, normals, cost, buckets, stitchBuckets,
-                          group, radius, BUCKET_SIZE, c2, 2, segments);
+    // choose best node for 'u' from the other side
+    vec2 ub = getBestNode(eu->second, normals, cost, grid, stitchGrid,
+                          forest, vertex, radius, c1, segments);
+    // choose best node for 'v' from the other side
+    vec2 vb = getBestNode(ev->second, normals, cost, grid, stitchGrid,
+                          forest, vertex, radius, c2, segments);
 
     // choose best
     vec2 u, v; // new (u, v) to be made
@@ -2607,10 +2778,14 @@ std::unordered_map<vec2, std::list<vec2>, HashVec> Image::cleanup(
     float w1 = weight(u, v, width, height, normals, cost);
     float w2 = weight(e.u, e.v, width, height, normals, cost);
 
-    if (w1 < w2) // (u, v) is good :)
+    if (w1 < w2) { // (u, v) is good :)
       addEdge(edge(u, v), spt);
-    else // damn!!!! all that wasted effort :(
+      forest.link(vertex[ids[u]], vertex[ids[v]]);
+    }
+    else { // damn!!!! all that wasted effort :(
       addEdge(edge(e.u, e.v), spt);
+      forest.link(vertex[eu->second], vertex[ev->second]);
+    }
   }
 
   /*
@@ -2636,6 +2811,70 @@ std::unordered_map<vec2, std::list<vec2>, HashVec> Image::cleanup(
   return spt;
 }
 
+template <typename Cost>
+std::vector<edge> Image::joinTrees(
+  const std::vector<vec2> &normals,
+  const std::vector<edge> &graph,
+  const std::vector<int> &around,
+  Cost cost,
+  const PointGrid &grid,
+  StitchGrid &stitchGrid,
+  const float radius,
+  const std::vector<edge> &segments) {
+
+  std::vector<edge> joins;
+
+  std::unordered_map<vec2, int, HashVec> ids;
+
+  for (int i = 0; i < grid.size(); ++i)
+    ids[grid.getPoint(i)] = i;
+
+  // the trees as a union-find
+  std::vector<int> root(grid.size());
+
+  for (int i = 0; i < grid.size(); ++i)
+    root[i] = i;
+
+  for (const edge &e : graph)
+    root[findRoot(root, ids[e.u])] = findRoot(root, ids[e.v]);
+
+  // every stitch out of 'around' into another tree, by cost
+  std::vector<std::pair<float, std::pair<int, int>>> candidates;
+  std::vector<int> n;
+
+  for (int u : around) {
+    generateNeighbors(grid.getPoint(u), grid, std::vector<bool>{}, radius,
+                      segments, n);
+
+    for (int v : n) {
+      if (findRoot(root, u) != findRoot(root, v))
+        candidates.push_back(std::make_pair(
+          weight(grid.getPoint(u), grid.getPoint(v), width, height, normals, cost),
+          std::make_pair(u, v)));
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+
+  // kruskal, the cheapest stitch between two trees that crosses nothing
+  for (const auto &c : candidates) {
+    const int u = c.second.first, v = c.second.second;
+
+    if (findRoot(root, u) == findRoot(root, v)) continue;
+
+    const vec2 &pu = grid.getPoint(u), &pv = grid.getPoint(v);
+
+    if (stitchGrid.findCrossing(pu, pv) != -1) continue;
+
+    root[findRoot(root, u)] = findRoot(root, v);
+
+    stitchGrid.add(pu, pv);
+    joins.push_back(edge(pu, pv));
+  }
+
+  return joins;
+}
+
 // sx, sy -> coordinates of source vertex
 std::deque<edge> Image::dijkstra(const std::vector<vec2> &normals,
                                  float(*cost)(vec2 &, vec2 &, vec2 &),
@@ -2803,11 +3042,12 @@ std::unordered_map<vec2, std::vector<vec2>, HashVec> Image::genGraph() {
 
 }
 
+template <typename Cost>
 std::vector<edge> Image::prim(
 
   std::unordered_map<vec2, std::vector<vec2>, HashVec> &graph,
   const std::vector<vec2> &normals,
-  float(*cost)(vec2 &, vec2 &, vec2 &)
+  Cost cost
 
 ) {
 
@@ -2893,3 +3133,51 @@ std::vector<edge> Image::prim(
 
   return edges;
 }
+
+// the cost models the planner is built for, see StitchCost.h
+#define INSTANTIATE_PLANNER(Cost) \
+  template void Image::plan(std::vector<edge> &, std::vector<vec2> &, \
+                            std::vector<vec2> &, Cost); \
+  template std::vector<edge> Image::findJumps(const std::vector<vec2> &, \
+                                              const std::vector<edge> &, Cost); \
+  template vec2 Image::getBestNode(const int, const std::vector<vec2> &, \
+                                   Cost, const PointGrid &, StitchGrid &, \
+                                   const EulerTourForest &, \
+                                   const std::vector<int> &, const float, \
+                                   float &, std::vector<edge> &); \
+  template std::unordered_map<vec2, std::list<vec2>, HashVec> Image::cleanup( \
+    const std::vector<vec2> &, const std::vector<edge> &, Cost, \
+    const PointGrid &, StitchGrid &, std::vector<edge> &); \
+  template std::unordered_map<vec2, std::list<vec2>, HashVec> Image::cleanup( \
+    const std::vector<vec2> &, const std::vector<edge> &, \
+    const std::vector<edge> &, Cost, \
+    const PointGrid &, StitchGrid &, std::vector<edge> &); \
+  template std::vector<edge> Image::joinTrees( \
+    const std::vector<vec2> &, const std::vector<edge> &, \
+    const std::vector<int> &, Cost, const PointGrid &, StitchGrid &, \
+    const float, const std::vector<edge> &); \
+  template std::vector<edge> Image::prim( \
+    std::unordered_map<vec2, std::vector<vec2>, HashVec> &, \
+    const std::vector<vec2> &, Cost);
+
+#define INSTANTIATE_DIJKSTRA(Cost1, Cost2) \
+  template std::vector<edge> Image::dijkstra(const int, const PointGrid &, \
+                                             StitchGrid &, \
+                                             const std::vector<vec2> &, \
+                                             Cost1, Cost2, \
+                                             const std::vector<edge> &); \
+  template std::vector<edge> Image::dijkstra(const std::vector<int> &, \
+                                             const std::vector<bool> &, \
+                                             const PointGrid &, \
+                                             StitchGrid &, \
+                                             const std::vector<vec2> &, \
+                                             Cost1, Cost2, \
+                                             const std::vector<edge> &);
+
+INSTANTIATE_PLANNER(CostFunction)
+INSTANTIATE_PLANNER(DirectionCost<ExactPow>)
+INSTANTIATE_PLANNER(DirectionCost<TablePow>)
+
+INSTANTIATE_DIJKSTRA(CostFunction, CostFunction)
+INSTANTIATE_DIJKSTRA(DirectionCost<ExactPow>, TurnCost<ExactPow>)
+INSTANTIATE_DIJKSTRA(DirectionCost<TablePow>, TurnCost<TablePow>)
@@ -110,6 +110,16 @@ const std::vector<VoronoiPoint*>& IntersectionNode::Get_IntersectingPoints() con
 	return intersectingPoints;
 }
 
+int IntersectionNode::Get_LayerIndex() const
+{
+	return layerIndex;
+}
+
+void IntersectionNode::Set_LayerIndex(int index)
+{
+	layerIndex = index;
+}
+
 bool IntersectionNode::EnvelopesSamePoints(const IntersectionNode& other) const
 {
 	if (other.intersectingPoints.size() != this->intersectingPoints.size()) return false;
@@ -1,32 +1,21 @@
 #include "Layer.h"
+#include "Helpers.h"
+#include "NearestSiteRaster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
+const unsigned int Layer::NO_INDEX;
+
 Layer::Layer(int sizeX, int sizeY, int zone)
 {
     this->sizeX = sizeX;
     this->sizeY = sizeY;
-
-    rawNormalData = PixelRGB::CreateContiguous2DPixmap(sizeX, sizeY);
-    rawDensityData = PixelRGB::CreateContiguous2DPixmap(sizeX, sizeY);
-
-    normalMap.resize(sizeX);
-    for (int x = 0; x < sizeX; x++)
-    {
-        std::vector<DynamicColor*> temp;
-        temp.reserve(sizeY);
-        for (int y = 0; y < sizeY; y++)
-        {
-            // Initialize with pixel from allocated pixmap. However visible pixels will be overrwritten (with Set_PixelRefs)
-            DynamicColor* newCol = new DynamicColor(&rawNormalData[y][x], &rawDensityData[y][x], Vector2D(x, y));
-            newCol->SetVoronoiZone(zone);
-            temp.push_back(newCol);
-        }
-        normalMap[x].insert(normalMap[x].end(), temp.begin(), temp.end());
-    }
-
-    pixelsToUpdate.reserve(normalMap.size() * normalMap[0].size());
+    this->zone = zone;
 }
 
 Layer::Layer(const std::string& normalName, const std::string& densityName, int sizeX, int sizeY, int zone)
@@ -34,6 +23,7 @@ Layer::Layer(const std::string& normalName, const std::string& densityName, int
     this->editable = false;
     this->sizeX = sizeX;
     this->sizeY = sizeY;
+    this->zone = zone;
 
     int width, height, bytes;
     unsigned char* pixels = stbi_load(normalName.c_str(), &width, &height, &bytes, 0);
@@ -87,7 +77,6 @@ Layer::Layer(const std::string& normalName, const std::string& densityName, int
         for (int x = 0; x < sizeX; ++x)
             for (int y = 0; y < sizeY; ++y)
             {
-                int index = bytes * (y * sizeX + x);
                 rawDensityData[y][x].r = 0;
                 rawDensityData[y][x].g = 0;
                 rawDensityData[y][x].b = 0;
@@ -96,76 +85,75 @@ Layer::Layer(const std::string& normalName, const std::string& densityName, int
     }
 
     stbi_image_free(pixels);
-
-    normalMap.resize(sizeX);
-    for (int x = 0; x < sizeX; x++)
-    {
-        std::vector<DynamicColor*> temp;
-        temp.reserve(sizeY);
-        for (int y = 0; y < sizeY; y++)
-        {
-            // Initialize with pixel from allocated pixmap. However visible pixels will be overrwritten (with Set_PixelRefs)
-            DynamicColor* newCol = new DynamicColor(&rawNormalData[y][x], &rawDensityData[y][x], Vector2D(x, y));
-            newCol->SetVoronoiZone(zone);
-            temp.push_back(newCol);
-        }
-        normalMap[x].insert(normalMap[x].end(), temp.begin(), temp.end());
-    }
-
-    for (int x = 0; x < sizeX; x++)
-    {
-        std::vector<DynamicColor*> temp;
-        temp.reserve(sizeY);
-        for (int y = 0; y < sizeY; y++)
-        {
-            // Initialize with pixel from allocated pixmap. However visible pixels will be overrwritten (with Set_PixelRefs)
-            DynamicColor* newCol = new DynamicColor(&rawNormalData[y][x], &rawDensityData[y][x], Vector2D(x, y));
-            newCol->SetVoronoiZone(zone);
-            temp.push_back(newCol);
-        }
-        normalMap[x].insert(normalMap[x].end(), temp.begin(), temp.end());
-    }
-
-    UpdateLayerAll(true);
-
-    pixelsToUpdate.reserve(normalMap.size() * normalMap[0].size());
 }
 
 Layer::~Layer()
 {
-    PixelRGB::DeleteContiguous2DPixmap(rawNormalData);
-    PixelRGB::DeleteContiguous2DPixmap(rawDensityData);
+    if (rawNormalData != nullptr)
+        PixelRGB::DeleteContiguous2DPixmap(rawNormalData);
+    if (rawDensityData != nullptr)
+        PixelRGB::DeleteContiguous2DPixmap(rawDensityData);
 }
 
 void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool updateBarycentric)
 {
-    ownedPoints.emplace(newPoint->Get_ID(), newPoint);
+    Materialize();
 
-    int floorPosX = newPoint->Get_Position()[0];
-    int floorPosY = newPoint->Get_Position()[1];
+    ownedPoints.emplace(newPoint->Get_ID(), newPoint);
+    sites.push_back(newPoint);
+    const unsigned int newSite = sites.size() - 1;
 
-    std::vector<DynamicColor*> pixelsToEvaluate;
+    // Pixels must be updated if their min point is overrwritten.
+    std::vector<int> pixelsToEvaluate = FloodNewCell(newSite);
     std::vector<int> redundantNodes;
 
-    // Pixels must be updated if their min point is overrwritten.
-    for (int x = 0; x < sizeX; x++)
-        for (int y = 0; y < sizeY; y++)
+    // Nodes right next to the new cell are redundant; only the buckets around it can hold them.
+    if (!pixelsToEvaluate.empty())
+    {
+        int minX = sizeX, minY = sizeY, maxX = 0, maxY = 0;
+        for (int index : pixelsToEvaluate)
         {
-            DynamicColor* it = normalMap[x][y];
-            if (it->TryAddMinPoint(newPoint))
+            minX = std::min(minX, index % sizeX);
+            maxX = std::max(maxX, index % sizeX);
+            minY = std::min(minY, index / sizeX);
+            maxY = std::max(maxY, index / sizeX);
+        }
+
+        // Nodes are bucketed by their position on screen.
+        minX += originX;
+        maxX += originX;
+        minY += originY;
+        maxY += originY;
+
+        for (int bx = (minX - 2) / NODE_BUCKET_SIZE; bx <= (maxX + 2) / NODE_BUCKET_SIZE; bx++)
+            for (int by = (minY - 2) / NODE_BUCKET_SIZE; by <= (maxY + 2) / NODE_BUCKET_SIZE; by++)
             {
-                pixelsToEvaluate.push_back(it);
+                auto bucket = nodeBuckets.find(((long long)bx << 32) | (unsigned int)by);
+                if (bucket == nodeBuckets.end()) continue;
 
-                for (auto& node : createdNodes)
+                for (int nodeID : bucket->second)
                 {
-                    if ((it->Get_PixelPosition() - node.second->Get_Position()).SqrMagnitude() <= 1.5)
-                    {
-                        redundantNodes.push_back(node.first);
-                    }
+                    const Vector2D& nodePos = createdNodes[nodeID]->Get_Position();
+                    bool redundant = false;
+
+                    // Taken over pixels are the ones visited by this insert that now have the new point.
+                    for (int x = (int)nodePos[0] - originX - 2; x <= (int)nodePos[0] - originX + 2 && !redundant; x++)
+                        for (int y = (int)nodePos[1] - originY - 2; y <= (int)nodePos[1] - originY + 2 && !redundant; y++)
+                        {
+                            if (x < 0 || x >= sizeX || y < 0 || y >= sizeY) continue;
+
+                            int index = y * sizeX + x;
+                            if (floodMarks[index] != floodStamp) continue;
+
+                            redundant = closestSite[index] == newSite &&
+                                (PixelPosition(index) - nodePos).SqrMagnitude() <= 1.5;
+                        }
+
+                    if (redundant)
+                        redundantNodes.push_back(nodeID);
                 }
             }
-
-        }
+    }
 
     // Check all pixels surrounding this one; if 3 unique min voronoi points are detected,
     // then we have found an intersection and will create a node.
@@ -173,18 +161,15 @@ void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool
     // intersection node along the EDGE of the screen.
     // If a pixel goes out of bounds in 2 axes AND 1 unique point is found, then we have a corner.
     std::unordered_map<int, VoronoiPoint*> affectedPoints;
-    for (auto& pix : pixelsToEvaluate)
+    for (int index : pixelsToEvaluate)
     {
-        int pixX = pix->Get_PixelPosition()[0];
-        int pixY = pix->Get_PixelPosition()[1];
-        int zone = pix->Get_VoronoiZone();
-
-        //std::cout << pix->Get_PixelPosition()[0] << " " << pix->Get_PixelPosition()[1] << "\n";
+        int pixX = index % sizeX;
+        int pixY = index / sizeX;
 
         int OOBx = 0;   // Determines if we HAVE GONE out of bounds at some point thus far (sign says direction)
         int OOBy = 0;   // Same as above, for y-direction.
         std::vector<VoronoiPoint*> uniquePoints;
-        Vector2D averagePos = Vector2D(pixX, pixY);
+        Vector2D averagePos = PixelPosition(index);
         uniquePoints.push_back(newPoint.get());
         for (int x = -1; x <= 1; x++)
         {
@@ -200,13 +185,14 @@ void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool
                 if (checkX < 0 || checkX >= sizeX) continue;
 
                 bool contains = false;
-                VoronoiPoint* add = normalMap[checkX][checkY]->Get_MinPoint();
-                if (add == nullptr) break;
+                unsigned int site = closestSite[checkY * sizeX + checkX];
+                if (site == NO_INDEX) break;
 
+                VoronoiPoint* add = sites[site].get();
                 affectedPoints[add->Get_ID()] = add;
                 for (auto* pt : uniquePoints)
                 {
-                    if (pt->Get_ID() == normalMap[checkX][checkY]->Get_MinPoint()->Get_ID())
+                    if (pt->Get_ID() == add->Get_ID())
                     {
                         contains = true;
                         break;
@@ -215,7 +201,7 @@ void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool
 
                 if (!contains)
                 {
-                    averagePos += Vector2D(checkX, checkY);
+                    averagePos += Vector2D(checkX + originX, checkY + originY);
                     uniquePoints.push_back(add);
                 }
             }
@@ -227,7 +213,7 @@ void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool
 
             std::shared_ptr<IntersectionNode> toAdd = std::make_shared<IntersectionNode>(averagePos, uniquePoints, zone);
 
-            createdNodes.emplace(toAdd->Get_ID(), std::shared_ptr<IntersectionNode>(toAdd));
+            InsertNode(toAdd);
             for (auto& pt : uniquePoints)
             {
                 pt->AddNode(std::shared_ptr<IntersectionNode>(toAdd));
@@ -236,27 +222,12 @@ void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool
     }
     pixelsToEvaluate.clear();
 
-    // Yikes ( O(n^3) )...
-    // But we want to update any pixels that have been affected by the change, which
+    // We want to update any pixels that have been affected by the change, which
     // will involve pixels outside of the new voronoi zone.
     for (auto& pt : affectedPoints)
     {
         if (updateBarycentric)
-        {
-            for (int x = 0; x < sizeX; x++)
-            {
-                for (int y = 0; y < sizeY; y++)
-                {
-                    VoronoiPoint* minPt = normalMap[x][y]->Get_MinPoint();
-                    if (minPt == nullptr) continue;
-
-                    if (minPt->Get_ID() == pt.first && minPt->Get_VoronoiZone() == pt.second->Get_VoronoiZone())
-                    {
-                        pixelsToUpdate.push_back(normalMap[x][y]);
-                    }
-                }
-            }
-        }
+            AppendCellPixels(pt.first, pixelsToUpdate);
 
         // Remove redundant nodes from voronoi points affected.
         for (auto& nodeID : redundantNodes)
@@ -268,7 +239,7 @@ void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool
     // Remove redundant nodes from global container (should be last ref. to them, making them delete as well)
     for (auto& nodeID : redundantNodes)
     {
-        createdNodes.erase(nodeID);
+        EraseNode(nodeID);
     }
 
     // Now that nodes are created, we need each pixel to know what triangle
@@ -278,61 +249,413 @@ void Layer::AddVoronoiPoint(const std::shared_ptr<VoronoiPoint>& newPoint, bool
         BarycentricUpdate(pixelsToUpdate);
 }
 
-void Layer::RemovePoint(const std::shared_ptr<VoronoiPoint>& toRemove)
+std::vector<int> Layer::FloodNewCell(unsigned int newSite)
 {
-    ownedPoints.erase(toRemove->Get_ID());
-    for (auto& node : toRemove->Get_NeighboringNodes())
+    std::vector<std::pair<int, int>> takenOver;  // Row major index and ID of the previous closest point.
+
+    if (floodMarks.empty())
+        floodMarks.assign(sizeX * sizeY, 0);
+
+    // Stamps only wrap after four billion inserts, but start over cleanly if they do.
+    if (++floodStamp == 0)
+    {
+        std::fill(floodMarks.begin(), floodMarks.end(), 0);
+        floodStamp = 1;
+    }
+
+    const Vector2D& site = sites[newSite]->Get_Position();
+    int startX = std::min(std::max((int)site[0] - originX, 0), sizeX - 1);
+    int startY = std::min(std::max((int)site[1] - originY, 0), sizeY - 1);
+
+    // The new cell is convex, so every pixel its area overlaps at all is within 1.5
+    // pixels (twice half a diagonal) of being closer to the new point than to its
+    // current closest one. Flooding through those pixels reaches all of the cell,
+    // even across slivers thinner than a pixel, and stops a pixel or two past it.
+    std::vector<int> toVisit;
+    toVisit.push_back(startY * sizeX + startX);
+    floodMarks[toVisit.back()] = floodStamp;
+
+    while (!toVisit.empty())
+    {
+        int index = toVisit.back();
+        toVisit.pop_back();
+
+        int x = index % sizeX;
+        int y = index / sizeX;
+
+        double sqrDistance = (site - PixelPosition(index)).SqrMagnitude();
+        float currentSqrDistance = SqrDistanceToSite(index);
+
+        float newDistance = std::sqrt(sqrDistance);
+        if (newDistance >= std::sqrt(currentSqrDistance) + 1.5f)
+            continue;
+
+        if ((float)sqrDistance < currentSqrDistance)
+        {
+            unsigned int previous = closestSite[index];
+            closestSite[index] = newSite;
+            takenOver.push_back({ index, (previous == NO_INDEX) ? -1 : sites[previous]->Get_ID() });
+        }
+
+        const int neighbors[4][2] = { { x - 1, y }, { x + 1, y }, { x, y - 1 }, { x, y + 1 } };
+        for (auto& n : neighbors)
+        {
+            if (n[0] < 0 || n[0] >= sizeX || n[1] < 0 || n[1] >= sizeY) continue;
+
+            int nIndex = n[1] * sizeX + n[0];
+            if (floodMarks[nIndex] == floodStamp) continue;
+
+            floodMarks[nIndex] = floodStamp;
+            toVisit.push_back(nIndex);
+        }
+    }
+
+    // Row major, then the pixels move from the cells they were in to the new one.
+    std::sort(takenOver.begin(), takenOver.end());
+
+    std::unordered_map<int, std::vector<int>> lostPixels;
+    std::vector<int> newCell;
+    newCell.reserve(takenOver.size());
+
+    for (auto& taken : takenOver)
     {
-        createdNodes.erase(node->Get_ID());
+        if (taken.second != -1)
+            lostPixels[taken.second].push_back(taken.first);
+        newCell.push_back(taken.first);
+    }
+
+    for (auto& lost : lostPixels)
+        RemoveFromCell(lost.first, lost.second);
+
+    std::vector<PixelRun>& runs = cellRuns[sites[newSite]->Get_ID()];
+    runs.clear();
+    for (int index : newCell)
+    {
+        int x = index % sizeX;
+        int y = index / sizeX;
+
+        if (!runs.empty() && runs.back().y == y && runs.back().x1 == x - 1)
+            runs.back().x1 = x;
+        else
+            runs.push_back({ y, x, x });
     }
+
+    // Same order a scan of the whole layer would find them in.
+    const int width = sizeX;
+    std::sort(newCell.begin(), newCell.end(), [width](int a, int b)
+    {
+        return a % width < b % width || (a % width == b % width && a < b);
+    });
+
+    return newCell;
 }
 
-void Layer::RecolorSelectedPoints(std::unordered_map<int, std::shared_ptr<VoronoiPoint>>& selectedPoints)
+void Layer::RemoveFromCell(int pointID, const std::vector<int>& pixels)
 {
-    pixelsToUpdate.clear();
+    auto found = cellRuns.find(pointID);
+    if (found == cellRuns.end()) return;
+
+    // Both are in row major order, so one pass splits the runs around the lost pixels.
+    std::vector<PixelRun> kept;
+    kept.reserve(found->second.size() + pixels.size());
+
+    size_t next = 0;
+    for (const PixelRun& run : found->second)
+    {
+        int from = run.x0;
+        int rowStart = run.y * sizeX;
+
+        while (next < pixels.size() && pixels[next] < rowStart + run.x0)
+            next++;
 
-    // If there's any room f
-    for (int x = 0; x < sizeX; x++)
-        for (int y = 0; y < sizeY; y++)
+        for (; next < pixels.size() && pixels[next] <= rowStart + run.x1; next++)
         {
-            DynamicColor* it = normalMap[x][y];
-            if (it->Get_TriNodeA() == nullptr || it->Get_TriNodeB() == nullptr)
-                continue;
+            int x = pixels[next] - rowStart;
+            if (x > from)
+                kept.push_back({ run.y, from, x - 1 });
+            from = x + 1;
+        }
+
+        if (from <= run.x1)
+            kept.push_back({ run.y, from, run.x1 });
+    }
+
+    found->second.swap(kept);
+}
+
+void Layer::AppendCellPixels(int pointID, std::vector<int>& pixels)
+{
+    auto found = cellRuns.find(pointID);
+    if (found == cellRuns.end()) return;
+
+    for (const PixelRun& run : found->second)
+        for (int x = run.x0; x <= run.x1; x++)
+            pixels.push_back(run.y * sizeX + x);
+}
+
+void Layer::BuildCellRuns()
+{
+    cellRuns.clear();
+
+    for (int y = 0; y < sizeY; y++)
+    {
+        const unsigned int* row = closestSite.data() + y * sizeX;
+
+        int x = 0;
+        while (x < sizeX)
+        {
+            unsigned int site = row[x];
+            int start = x;
+            while (x < sizeX && row[x] == site)
+                x++;
+
+            if (site != NO_INDEX)
+                cellRuns[sites[site]->Get_ID()].push_back({ y, start, x - 1 });
+        }
+    }
+}
+
+void Layer::Rebuild(const std::vector<std::shared_ptr<VoronoiPoint>>& points, int numThreads)
+{
+    for (auto& pt : ownedPoints)
+        pt.second->ClearNodes();
+
+    ownedPoints.clear();
+    ClearNodes();
+    pixelsToUpdate.clear();
+
+    for (auto& pt : points)
+    {
+        pt->ClearNodes();
+        ownedPoints.emplace(pt->Get_ID(), pt);
+    }
+
+    if (points.empty())
+    {
+        ClearData();
+        return;
+    }
 
-            // Pixel should update if it's barcentric blending is involved with the points'
-            // nodes, since those nodes are influenced by the points themselves.
-            for (auto& ptA : it->Get_TriNodeA()->Get_IntersectingPoints())
+    Materialize();
+    sites = points;
+
+    // Closest points straight into the layer's own plane.
+    {
+        std::vector<Vector2D> positions;
+        positions.reserve(points.size());
+        for (auto& pt : points)
+            positions.push_back(pt->Get_Position() - Vector2D(originX, originY));
+
+        NearestSiteRaster nearestSites(sizeX, sizeY);
+        nearestSites.Build(positions, closestSite.data(), numThreads);
+    }
+
+    // Intersections, found per batch of rows, then made into nodes in row order
+    // so the result doesn't depend on the threads. Same rules as adding a point:
+    // 3 unique points around a pixel, or fewer along the edges of the screen. The
+    // pixel itself stands for its own closest point, as the new point does there.
+    struct FoundNode
+    {
+        Vector2D position;
+        int count;
+        unsigned int sites[9];
+    };
+
+    const int numBatches = (sizeY + ROW_BATCH - 1) / ROW_BATCH;
+    std::vector<std::vector<FoundNode>> found(numBatches);
+
+    Helpers::ForEachRowBatch(sizeY, ROW_BATCH, numThreads, [&](int rowBegin, int rowEnd)
+    {
+        std::vector<FoundNode>& batch = found[rowBegin / ROW_BATCH];
+
+        for (int pixY = rowBegin; pixY < rowEnd; pixY++)
+            for (int pixX = 0; pixX < sizeX; pixX++)
             {
-                if (selectedPoints.count(ptA->Get_ID()) >= 1)
+                // Away from the edges, most pixels only have their own point around them.
+                if (pixX > 0 && pixX < sizeX - 1 && pixY > 0 && pixY < sizeY - 1)
                 {
-                    pixelsToUpdate.push_back(it);
-                    continue;
+                    const unsigned int* mid = &closestSite[pixY * sizeX + pixX];
+                    const unsigned int* above = mid - sizeX;
+                    const unsigned int* below = mid + sizeX;
+                    unsigned int own = *mid;
+                    if (above[-1] == own && above[0] == own && above[1] == own && mid[-1] == own && mid[1] == own
+                        && below[-1] == own && below[0] == own && below[1] == own)
+                        continue;
                 }
-            }
 
-            for (auto& ptB : it->Get_TriNodeB()->Get_IntersectingPoints())
-            {
-                if (selectedPoints.count(ptB->Get_ID()) >= 1)
+                FoundNode node;
+                node.sites[0] = closestSite[pixY * sizeX + pixX];
+                node.count = 1;
+
+                // Screen coords summed as ints, as only a few pixels turn out to be nodes.
+                int sumX = pixX + originX;
+                int sumY = pixY + originY;
+
+                int OOBx = 0;
+                int OOBy = 0;
+                for (int x = -1; x <= 1; x++)
+                {
+                    int checkX = pixX + x;
+                    OOBx = (OOBx == 0) ? ((checkX < 0) ? -1 : (checkX >= sizeX) ? 1 : 0) : OOBx;
+
+                    for (int y = -1; y <= 1; y++)
+                    {
+                        int checkY = pixY + y;
+                        OOBy = (OOBy == 0) ? ((checkY < 0) ? -1 : (checkY >= sizeY) ? 1 : 0) : OOBy;
+
+                        if (checkY < 0 || checkY >= sizeY) continue;
+                        if (checkX < 0 || checkX >= sizeX) continue;
+
+                        unsigned int add = closestSite[checkY * sizeX + checkX];
+                        if (std::find(node.sites, node.sites + node.count, add) == node.sites + node.count)
+                        {
+                            sumX += checkX + originX;
+                            sumY += checkY + originY;
+                            node.sites[node.count++] = add;
+                        }
+                    }
+                }
+
+                if (node.count + std::abs(OOBx) + std::abs(OOBy) >= 3)
                 {
-                    pixelsToUpdate.push_back(it);
-                    break;
+                    node.position = Vector2D(sumX, sumY) / node.count;
+                    batch.push_back(node);
                 }
             }
+    });
+
+    // Nodes are gathered per point and handed over at once, so every point sorts its
+    // nodes by angle a single time rather than once per node.
+    size_t numFound = 0;
+    for (auto& batch : found)
+        numFound += batch.size();
+
+    nodeTable.reserve(numFound);
+    createdNodes.reserve(numFound);
+
+    std::vector<std::vector<std::shared_ptr<IntersectionNode>>> siteNodes(sites.size());
+    std::vector<VoronoiPoint*> uniquePoints;
+    for (auto& batch : found)
+        for (auto& node : batch)
+        {
+            uniquePoints.clear();
+            for (int i = 0; i < node.count; i++)
+                uniquePoints.push_back(sites[node.sites[i]].get());
+
+            std::shared_ptr<IntersectionNode> toAdd = std::make_shared<IntersectionNode>(node.position, uniquePoints, zone);
+
+            InsertNode(toAdd);
+            for (int i = 0; i < node.count; i++)
+                siteNodes[node.sites[i]].push_back(toAdd);
+        }
+
+    // Angles of every point's nodes, back to back, for the triangle search below.
+    // Helpers::PseudoAngle sorts like the angles AddNodes sorted the nodes by.
+    std::vector<size_t> angleStart(sites.size() + 1, 0);
+    for (size_t i = 0; i < sites.size(); i++)
+        angleStart[i + 1] = angleStart[i] + siteNodes[i].size();
+
+    std::vector<float> nodeAngles(angleStart.back());
+
+    Helpers::ForEachRowBatch((int)sites.size(), ROW_BATCH, numThreads, [&](int siteBegin, int siteEnd)
+    {
+        for (int i = siteBegin; i < siteEnd; i++)
+        {
+            sites[i]->AddNodes(siteNodes[i]);
+
+            const auto& nodeList = sites[i]->Get_NeighboringNodes();
+            const Vector2D& sitePos = sites[i]->Get_Position();
+            for (size_t j = 0; j < nodeList.size(); j++)
+            {
+                const Vector2D& nodePos = nodeList[j]->Get_Position();
+                nodeAngles[angleStart[i] + j] = Helpers::PseudoAngle(nodePos[0] - sitePos[0], nodePos[1] - sitePos[1]);
+            }
         }
+    });
+
+    // Now every point has all its nodes: triangle and color of every pixel in the zone.
+    Helpers::ForEachRowBatch(sizeY, ROW_BATCH, numThreads, [&](int rowBegin, int rowEnd)
+    {
+        for (int index = rowBegin * sizeX; index < rowEnd * sizeX; index++)
+        {
+            triNodeA[index] = NO_INDEX;
+            triNodeB[index] = NO_INDEX;
+            baryU[index] = baryV[index] = baryW[index] = 0;
+
+            if (!inZone[index]) continue;
+
+            UpdateTriangle(index, closestSite[index] == NO_INDEX ? nullptr : nodeAngles.data() + angleStart[closestSite[index]]);
+            UpdatePixel(index);
+        }
+    });
+
+    BuildCellRuns();
+}
+
+void Layer::RemovePoint(const std::shared_ptr<VoronoiPoint>& toRemove)
+{
+    ownedPoints.erase(toRemove->Get_ID());
+    cellRuns.erase(toRemove->Get_ID());
+    for (auto& node : toRemove->Get_NeighboringNodes())
+    {
+        EraseNode(node->Get_ID());
+    }
+}
+
+void Layer::RecolorSelectedPoints(std::unordered_map<int, std::shared_ptr<VoronoiPoint>>& selectedPoints)
+{
+    pixelsToUpdate.clear();
+
+    // Only cells sharing a node with a selected point blend with its nodes: its own
+    // and those of the other points on its nodes.
+    std::unordered_map<int, bool> cells;
+    for (auto& selected : selectedPoints)
+    {
+        if (ownedPoints.count(selected.first) == 0) continue;
+
+        cells[selected.first] = true;
+        for (auto& node : selected.second->Get_NeighboringNodes())
+            for (auto* pt : node->Get_IntersectingPoints())
+                cells[pt->Get_ID()] = true;
+    }
+
+    std::vector<int> candidates;
+    for (auto& cell : cells)
+        AppendCellPixels(cell.first, candidates);
+
+    for (int index : candidates)
+    {
+        if (triNodeA[index] == NO_INDEX || triNodeB[index] == NO_INDEX)
+            continue;
+
+        // Pixel should update if it's barcentric blending is involved with the points'
+        // nodes, since those nodes are influenced by the points themselves.
+        bool involved = false;
+        for (auto& ptA : nodeTable[triNodeA[index]]->Get_IntersectingPoints())
+            involved = involved || selectedPoints.count(ptA->Get_ID()) >= 1;
+
+        for (auto& ptB : nodeTable[triNodeB[index]]->Get_IntersectingPoints())
+            involved = involved || selectedPoints.count(ptB->Get_ID()) >= 1;
+
+        if (involved)
+            pixelsToUpdate.push_back(index);
+    }
 }
 
 void Layer::UpdateLayerAll(bool barycentric)
 {
-    if (ownedPoints.size() == 0) return;
+    if (ownedPoints.size() == 0 || !materialized) return;
 
-    for (int x = 0; x < sizeX; x++)
+    Helpers::ForEachRowBatch(sizeY, ROW_BATCH, 0, [&](int rowBegin, int rowEnd)
     {
-        if (barycentric) BarycentricUpdate(normalMap[x]);
-        for (int y = 0; y < sizeY; y++)
+        for (int index = rowBegin * sizeX; index < rowEnd * sizeX; index++)
         {
-            normalMap[x][y]->UpdatePixel();
+            if (!inZone[index]) continue;
+
+            if (barycentric) UpdateTriangle(index);
+            UpdatePixel(index);
         }
-    }
+    });
 }
 
 void Layer::CancelUpdate()
@@ -342,26 +665,29 @@ void Layer::CancelUpdate()
 
 void Layer::ClearData()
 {
-    for (int x = 0; x < sizeX; x++)
-        for (int y = 0; y < sizeY; y++)
-        {
-            normalMap[x][y]->ClearVoronoiData(editable);
-        }
+    // Static layers have no voronoi data, and keep their colors. Nor do layers never edited.
+    if (materialized)
+    {
+        for (int index = 0; index < sizeX * sizeY; index++)
+            ClearPixel(index, true);
+    }
 
     for (auto& vPt : ownedPoints)
     {
         vPt.second->ClearNodes();
     }
 
-    createdNodes.clear();
+    ClearNodes();
     ownedPoints.clear();
+    sites.clear();
+    cellRuns.clear();
 }
 
 void Layer::UpdateQueuedPixels()
 {
-    for (auto& pix : pixelsToUpdate)
+    for (int index : pixelsToUpdate)
     {
-        pix->UpdatePixel();
+        UpdatePixel(index);
     }
 }
 
@@ -386,103 +712,227 @@ void Layer::RenderLayer(SDL_Renderer* rend, bool debugDisplay)
     }
 }
 
-void Layer::Set_PixelRefs(int x, int y, PixelRGB* normalPix, PixelRGB* densityPix)
+void Layer::Set_OutputPixmaps(PixelRGB** normalPixels, PixelRGB** densityPixels)
 {
-    PixelRGB::Copy(&rawNormalData[y][x], normalPix);
-    PixelRGB::Copy(&rawDensityData[y][x], densityPix);
-	return normalMap[x][y]->Set_AffectedPixels(normalPix, densityPix);
+    normalOutput = normalPixels;
+    densityOutput = densityPixels;
 }
 
-void Layer::CheckForIntersections(const std::vector<DynamicColor*>& toCheck)
+void Layer::Set_InZone(int x, int y)
 {
-    for (auto& pix : toCheck)
+    if (!editable)
     {
-        int pixX = pix->Get_PixelPosition()[0];
-        int pixY = pix->Get_PixelPosition()[1];
-        int zone = pix->Get_VoronoiZone();
+        PixelRGB::Copy(&rawNormalData[y][x], &normalOutput[y][x]);
+        PixelRGB::Copy(&rawDensityData[y][x], &densityOutput[y][x]);
+        return;
+    }
 
-        //std::cout << pix->Get_PixelPosition()[0] << " " << pix->Get_PixelPosition()[1] << "\n";
+    // Kept as runs until the planes exist.
+    if (materialized)
+    {
+        if (x >= originX && x < originX + sizeX && y >= originY && y < originY + sizeY)
+            inZone[(y - originY) * sizeX + (x - originX)] = 1;
+    }
+    else if (!zoneRuns.empty() && zoneRuns.back().y == y && zoneRuns.back().x1 == x - 1)
+        zoneRuns.back().x1 = x;
+    else
+        zoneRuns.push_back({ y, x, x });
 
-        int OOBx = 0;   // Determines if we HAVE GONE out of bounds at some point thus far (sign says direction)
-        int OOBy = 0;   // Same as above, for y-direction.
-        std::vector<VoronoiPoint*> uniquePoints;
-        Vector2D averagePos = Vector2D(pixX, pixY);
-        for (int x = -1; x <= 1; x++)
-        {
-            int checkX = pixX + x;
-            OOBx = (OOBx == 0) ? ((checkX < 0) ? -1 : (checkX >= sizeX) ? 1 : 0) : OOBx;
+    // Until a point reaches it, the pixel shows the normal map default and a middle gray density.
+    Helpers::NormalMapDefaultColor(&normalOutput[y][x]);
+    densityOutput[y][x] = PixelRGB::MakePixel(128, 128, 128);
+}
 
-            for (int y = -1; y <= 1; y++)
-            {
-                int checkY = pixY + y;
-                OOBy = (OOBy == 0) ? ((checkY < 0) ? -1 : (checkY >= sizeY) ? 1 : 0) : OOBy;
+void Layer::InsertNode(const std::shared_ptr<IntersectionNode>& node)
+{
+    const Vector2D& pos = node->Get_Position();
+    long long key = ((long long)((int)pos[0] / NODE_BUCKET_SIZE) << 32) | (unsigned int)((int)pos[1] / NODE_BUCKET_SIZE);
 
-                if (checkY < 0 || checkY >= sizeY) continue;
-                if (checkX < 0 || checkX >= sizeX) continue;
+    node->Set_LayerIndex(nodeTable.size());
+    nodeTable.push_back(node);
 
-                bool contains = false;
-                VoronoiPoint* add = normalMap[checkX][checkY]->Get_MinPoint();
-                if (add == nullptr) break;
+    createdNodes.emplace(node->Get_ID(), node);
+    nodeBuckets[key].push_back(node->Get_ID());
+}
 
-                for (auto* pt : uniquePoints)
-                {
-                    if (pt->Get_ID() == normalMap[checkX][checkY]->Get_MinPoint()->Get_ID())
-                    {
-                        contains = true;
-                        break;
-                    }
-                }
+void Layer::EraseNode(int nodeID)
+{
+    auto found = createdNodes.find(nodeID);
+    if (found == createdNodes.end()) return;
 
-                if (!contains)
-                {
-                    averagePos += Vector2D(checkX, checkY);
-                    uniquePoints.push_back(add);
-                }
-            }
-        }
+    const Vector2D& pos = found->second->Get_Position();
+    long long key = ((long long)((int)pos[0] / NODE_BUCKET_SIZE) << 32) | (unsigned int)((int)pos[1] / NODE_BUCKET_SIZE);
 
-        if (uniquePoints.size() + std::abs(OOBx) + std::abs(OOBy) >= 3)
-        {
-            averagePos /= (int)uniquePoints.size();
+    std::vector<int>& bucket = nodeBuckets[key];
+    bucket.erase(std::find(bucket.begin(), bucket.end(), nodeID));
+    if (bucket.empty())
+        nodeBuckets.erase(key);
 
-            std::shared_ptr<IntersectionNode> toAdd = std::make_shared<IntersectionNode>(averagePos, uniquePoints, zone);
+    createdNodes.erase(found);
+}
 
-            createdNodes.emplace(toAdd->Get_ID(), std::shared_ptr<IntersectionNode>(toAdd));
-            for (auto& pt : uniquePoints)
-            {
-                pt->AddNode(std::shared_ptr<IntersectionNode>(toAdd));
-            }
+void Layer::ClearNodes()
+{
+    createdNodes.clear();
+    nodeBuckets.clear();
+    nodeTable.clear();
+}
+
+void Layer::Materialize()
+{
+    if (materialized) return;
+
+    if (!zoneRuns.empty())
+    {
+        int minX = zoneRuns[0].x0, maxX = zoneRuns[0].x1;
+        int minY = zoneRuns[0].y, maxY = zoneRuns[0].y;
+        for (const PixelRun& run : zoneRuns)
+        {
+            minX = std::min(minX, run.x0);
+            maxX = std::max(maxX, run.x1);
+            minY = std::min(minY, run.y);
+            maxY = std::max(maxY, run.y);
         }
+
+        originX = minX;
+        originY = minY;
+        sizeX = maxX - minX + 1;
+        sizeY = maxY - minY + 1;
     }
+
+    // No closest points or triangles yet.
+    int pixelCount = sizeX * sizeY;
+    closestSite.assign(pixelCount, NO_INDEX);
+    triNodeA.assign(pixelCount, NO_INDEX);
+    triNodeB.assign(pixelCount, NO_INDEX);
+    baryU.assign(pixelCount, 0);
+    baryV.assign(pixelCount, 0);
+    baryW.assign(pixelCount, 0);
+    inZone.assign(pixelCount, 0);
+
+    for (const PixelRun& run : zoneRuns)
+        std::fill(inZone.begin() + (run.y - originY) * sizeX + (run.x0 - originX),
+            inZone.begin() + (run.y - originY) * sizeX + (run.x1 - originX) + 1, 1);
+
+    zoneRuns.clear();
+    zoneRuns.shrink_to_fit();
+    materialized = true;
+}
+
+float Layer::SqrDistanceToSite(int index) const
+{
+    if (closestSite[index] == NO_INDEX)
+        return FLT_MAX;
+
+    return (sites[closestSite[index]]->Get_Position() - PixelPosition(index)).SqrMagnitude();
+}
+
+void Layer::ClearPixel(int index, bool resetColor)
+{
+    closestSite[index] = NO_INDEX;
+    triNodeA[index] = NO_INDEX;
+    triNodeB[index] = NO_INDEX;
+    baryU[index] = baryV[index] = baryW[index] = 0;
+
+    if (resetColor && inZone[index])
+        Helpers::NormalMapDefaultColor(&normalOutput[index / sizeX + originY][index % sizeX + originX]);
 }
 
-void Layer::BarycentricUpdate(const std::vector<DynamicColor*>& toUpdate)
+void Layer::UpdateTriangle(int index, const float* nodeAngles)
 {
+    if (closestSite[index] == NO_INDEX) return;
+
     // If a triangle formed by using the voronoi point and two adjacent nodes overlaps a pixel,
     // then it resides within that triangle and should update color according to those nodes
     // and calculated coordinates.
-    for (auto& pix : toUpdate)
+    const VoronoiPoint* evalPt = sites[closestSite[index]].get();
+    const auto& nodeList = evalPt->Get_NeighboringNodes();
+    Vector2D pixPosition = PixelPosition(index);
+
+    // If true, we found the triangle this pixel resides in. Now compute its relative coordinates
+    // and set its required references for rendering.
+    auto tryTriangle = [&](int i)
     {
-        auto evalPt = pix->Get_MinPoint();
-        auto nodeList = evalPt->Get_NeighboringNodes();
-        bool success = false;
-        for (int i = 0; i < nodeList.size(); i++)
-        {
-            int next = (i + 1) % nodeList.size();
+        int next = (i + 1) % nodeList.size();
+        float u, v, w;
+        if (!Helpers::PointTriangleIntersection(pixPosition, evalPt->Get_Position(),
+            nodeList[i]->Get_Position(), nodeList[next]->Get_Position(), u, v, w))
+            return false;
+
+        triNodeA[index] = nodeList[i]->Get_LayerIndex();
+        triNodeB[index] = nodeList[next]->Get_LayerIndex();
+        baryU[index] = (unsigned short)std::lround(Helpers::Clamp(u, 0.0f, 1.0f) * BARY_SCALE);
+        baryV[index] = (unsigned short)std::lround(Helpers::Clamp(v, 0.0f, 1.0f) * BARY_SCALE);
+        baryW[index] = (unsigned short)std::lround(Helpers::Clamp(w, 0.0f, 1.0f) * BARY_SCALE);
+        return true;
+    };
+
+    // Nodes go by descending angle around the point, so the triangle whose angles span the
+    // pixel's is the one before the first node at or below it. Past either end, that's the
+    // triangle closing the fan between the last node and the first.
+    if (nodeAngles && !nodeList.empty())
+    {
+        int count = (int)nodeList.size();
+        float pixAngle = Helpers::PseudoAngle(pixPosition[0] - evalPt->Get_Position()[0], pixPosition[1] - evalPt->Get_Position()[1]);
+        int below = (int)(std::lower_bound(nodeAngles, nodeAngles + count, pixAngle, std::greater<float>()) - nodeAngles);
 
-            // If true, we found the triangle this pixel resides in. Now compute its relative coordinates
-            // and set its required references for rendering.
-            if (Helpers::PointTriangleIntersection(pix->Get_PixelPosition(), evalPt->Get_Position(),
-                nodeList[i]->Get_Position(), nodeList[next]->Get_Position()))
-            {
-                pix->Set_TriangulationNodes(nodeList[i], nodeList[next], evalPt->Get_Position());
-                success = true;
-                break;
-            }
-        }
+        if (tryTriangle((below == 0) ? count - 1 : below - 1))
+            return;
+    }
 
-        if (success) continue;
+    for (int i = 0; i < nodeList.size(); i++)
+        if (tryTriangle(i))
+            return;
 
-        //std::cout << "Could not find triangle for pixel\n";
+    //std::cout << "Could not find triangle for pixel\n";
+}
+
+void Layer::UpdatePixel(int index)
+{
+    if (!inZone[index]) return;
+
+    PixelRGB* normalPix = &normalOutput[index / sizeX + originY][index % sizeX + originX];
+    PixelRGB* densityPix = &densityOutput[index / sizeX + originY][index % sizeX + originX];
+
+    // Base color is that of closest point if we have one stored. If not, it's the default color.
+    if (closestSite[index] == NO_INDEX)
+    {
+        Helpers::NormalMapDefaultColor(normalPix);
+        return;
     }
-}
\ No newline at end of file
+
+    const VoronoiPoint* minPt = sites[closestSite[index]].get();
+    PixelRGB::Copy(&minPt->Get_NormalEncoding(), normalPix);
+
+    if (triNodeA[index] == NO_INDEX || triNodeB[index] == NO_INDEX) return;
+
+    // Blend the closest point and the two nodes by the pixel's barycentric coordinates
+    // within the triangle they form, for both color and density.
+    const IntersectionNode* nodeA = nodeTable[triNodeA[index]].get();
+    const IntersectionNode* nodeB = nodeTable[triNodeB[index]].get();
+    float u = baryU[index] / (float)BARY_SCALE;
+    float v = baryV[index] / (float)BARY_SCALE;
+    float w = baryW[index] / (float)BARY_SCALE;
+
+    const PixelRGB& colA = minPt->Get_NormalEncoding();
+    const PixelRGB& colB = nodeA->Get_AverageColor();
+    const PixelRGB& colC = nodeB->Get_AverageColor();
+
+    normalPix->r = Helpers::Clamp(u * colA.r + v * colB.r + w * colC.r, 0, 255);
+    normalPix->g = Helpers::Clamp(u * colA.g + v * colB.g + w * colC.g, 0, 255);
+    normalPix->b = Helpers::Clamp(u * colA.b + v * colB.b + w * colC.b, 0, 255);
+
+    float density = Helpers::Clamp(u * minPt->Get_VoronoiDensity() + v * nodeA->Get_AverageDensity() + w * nodeB->Get_AverageDensity(), 0, 255);
+    densityPix->r = (Uint8)density;
+    densityPix->g = densityPix->r;
+    densityPix->b = densityPix->r;
+}
+
+void Layer::BarycentricUpdate(const std::vector<int>& toUpdate)
+{
+    for (int index : toUpdate)
+    {
+        if (inZone[index])
+            UpdateTriangle(index);
+    }
+}
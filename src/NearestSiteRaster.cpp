@@ -0,0 +1,142 @@
+#include "NearestSiteRaster.h"
+#include "Helpers.h"
+
+#include <algorithm>
+#include <cmath>
+
+const unsigned int NearestSiteRaster::NO_SITE;
+
+NearestSiteRaster::NearestSiteRaster(int sizeX, int sizeY)
+{
+    this->sizeX = sizeX;
+    this->sizeY = sizeY;
+    this->nearest = nullptr;
+}
+
+void NearestSiteRaster::Build(const std::vector<Vector2D>& sites, unsigned int* nearest, int numThreads)
+{
+    const int pixelCount = sizeX * sizeY;
+    const int siteCount = (int)sites.size();
+
+    this->nearest = nearest;
+
+    if (siteCount == 0)
+    {
+        std::fill(nearest, nearest + pixelCount, NO_SITE);
+        return;
+    }
+
+    siteX.resize(siteCount);
+    siteY.resize(siteCount);
+
+    for (int s = 0; s < siteCount; s++)
+    {
+        siteX[s] = (float)sites[s][0];
+        siteY[s] = (float)sites[s][1];
+    }
+
+    // About one site per bucket. Sites off the raster go in the nearest bucket,
+    // which only ever makes them look closer than they are.
+    bucketSize = std::max(4, (int)std::sqrt((double)pixelCount / siteCount));
+    bucketsX = sizeX / bucketSize + 1;
+    bucketsY = sizeY / bucketSize + 1;
+
+    std::vector<int> bucketOf(siteCount);
+    bucketStart.assign(bucketsX * bucketsY + 1, 0);
+
+    for (int s = 0; s < siteCount; s++)
+    {
+        int bx = std::min(std::max((int)std::floor(siteX[s] / bucketSize), 0), bucketsX - 1);
+        int by = std::min(std::max((int)std::floor(siteY[s] / bucketSize), 0), bucketsY - 1);
+        bucketOf[s] = by * bucketsX + bx;
+        bucketStart[bucketOf[s] + 1]++;
+    }
+
+    for (int b = 0; b < bucketsX * bucketsY; b++)
+        bucketStart[b + 1] += bucketStart[b];
+
+    // Sites in index order within each bucket.
+    bucketSites.resize(siteCount);
+    std::vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for (int s = 0; s < siteCount; s++)
+        bucketSites[fill[bucketOf[s]]++] = s;
+
+    const int tilesY = (sizeY + TILE_SIZE - 1) / TILE_SIZE;
+
+    Helpers::ForEachRowBatch(tilesY, 1, numThreads, [&](int rowBegin, int rowEnd)
+    {
+        std::vector<int> candidates;
+
+        for (int ty = rowBegin; ty < rowEnd; ty++)
+            for (int tx = 0; tx < sizeX; tx += TILE_SIZE)
+                BuildTile(tx, ty * TILE_SIZE, candidates);
+    });
+}
+
+void NearestSiteRaster::BuildTile(int tileX, int tileY, std::vector<int>& candidates)
+{
+    const int endX = std::min(tileX + TILE_SIZE, sizeX);
+    const int endY = std::min(tileY + TILE_SIZE, sizeY);
+
+    const float* sx = siteX.data();
+    const float* sy = siteY.data();
+
+    float margin = 1.5f * bucketSize;
+
+    while (true)
+    {
+        // Every site outside these buckets is more than margin away from every pixel of the tile.
+        int bx0 = std::max((int)std::floor((tileX - margin) / bucketSize), 0);
+        int by0 = std::max((int)std::floor((tileY - margin) / bucketSize), 0);
+        int bx1 = std::min((int)std::floor((endX - 1 + margin) / bucketSize), bucketsX - 1);
+        int by1 = std::min((int)std::floor((endY - 1 + margin) / bucketSize), bucketsY - 1);
+
+        bool everything = bx0 == 0 && by0 == 0 && bx1 == bucketsX - 1 && by1 == bucketsY - 1;
+
+        candidates.clear();
+        for (int by = by0; by <= by1; by++)
+            for (int b = by * bucketsX + bx0; b <= by * bucketsX + bx1; b++)
+                candidates.insert(candidates.end(), bucketSites.begin() + bucketStart[b], bucketSites.begin() + bucketStart[b + 1]);
+
+        // In index order, so strict comparisons leave ties with the earlier site.
+        std::sort(candidates.begin(), candidates.end());
+
+        float farthestNearest = 0.0f;
+
+        for (int y = tileY; y < endY; y++)
+        {
+            const float fy = (float)y;
+
+            for (int x = tileX; x < endX; x++)
+            {
+                const float fx = (float)x;
+
+                unsigned int best = NO_SITE;
+                float bestDistance = FLT_MAX;
+
+                // Squared distances.
+                for (int s : candidates)
+                {
+                    const float dx = sx[s] - fx, dy = sy[s] - fy;
+                    const float d = dx * dx + dy * dy;
+
+                    if (d < bestDistance)
+                    {
+                        best = s;
+                        bestDistance = d;
+                    }
+                }
+
+                nearest[y * sizeX + x] = best;
+
+                farthestNearest = std::max(farthestNearest, bestDistance);
+            }
+        }
+
+        if (everything || farthestNearest <= margin * margin)
+            return;
+
+        // Wide enough for the farthest nearest site found, if there was one everywhere.
+        margin = (farthestNearest == FLT_MAX) ? 2 * margin : std::max(margin + bucketSize, std::sqrt(farthestNearest) + 1);
+    }
+}
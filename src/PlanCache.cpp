@@ -0,0 +1,226 @@
+#include "PlanCache.h"
+#include "BinaryIO.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+// bump whenever sampling, planning or the file layout changes, so that old
+// entries are never mistaken for what the new code would compute
+static const uint32_t CACHE_VERSION = 2;
+
+static const char MAGIC[4] = {'D', 'S', 'W', 'C'};
+
+enum EntryKind : uint32_t { ENTRY_POINTS = 1, ENTRY_PLAN = 2 };
+
+void CacheKey::add(const void *data, size_t size) {
+
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+}
+
+void CacheKey::addImage(Image *image) {
+
+  const int width = image->getWidth(), height = image->getHeight();
+
+  add(width);
+  add(height);
+  add(image->getPixmap(), 4 * (size_t)width * height);
+}
+
+std::string CacheKey::name() const {
+
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+
+  return buffer;
+}
+
+CacheKey pointsCacheKey(Image *densityMap, const PointSampler sampler,
+                        const int subgridSize,
+                        const QuadtreeParams &quadtree,
+                        const CVTParams &cvt) {
+
+  CacheKey key;
+
+  key.add(CACHE_VERSION);
+  key.add((uint32_t)ENTRY_POINTS);
+  key.add(getRandomSeed());
+  key.add((int)sampler);
+
+  // only what the sampler looks at, thread counts never change the points
+  if (sampler == SAMPLER_GRID)
+    key.add(subgridSize);
+  else if (sampler == SAMPLER_CVT) {
+    key.add(cvt.maxIterations);
+    key.add(cvt.tolerance);
+  }
+  else if (sampler == SAMPLER_QUADTREE) {
+    key.add(quadtree.mmPerPixel);
+    key.add(quadtree.spacing);
+    key.add(quadtree.maxDeviation);
+    key.add(quadtree.maxLeafPoints);
+    key.add(quadtree.maxDepth);
+  }
+
+  key.addImage(densityMap);
+
+  return key;
+}
+
+CacheKey planCacheKey(const CacheKey &points, Image *normalMap,
+                      const PlanParams &params, const int numStarts,
+                      const PlanScore score) {
+
+  CacheKey key;
+
+  key.add(CACHE_VERSION);
+  key.add((uint32_t)ENTRY_PLAN);
+  key.add(points.value());
+  key.add(getRandomSeed());
+  key.add(params.alpha1);
+  key.add(params.beta1);
+  key.add(params.alpha2);
+  key.add(params.beta2);
+  key.add(params.targetSCR);
+  key.add((int)params.cost);
+  key.add(numStarts);
+  key.add((int)score);
+  key.addImage(normalMap);
+
+  return key;
+}
+
+PlanCache::PlanCache(const std::string &directory) : directory(directory) {}
+
+std::string PlanCache::path(const CacheKey &key, const char *kind) const {
+  return directory + "/" + key.name() + "." + kind;
+}
+
+// opens the entry and checks its header
+static bool openEntry(std::ifstream &in, const std::string &path,
+                      const CacheKey &key, const EntryKind kind) {
+
+  in.open(path, std::ios::binary);
+
+  char magic[4];
+  uint32_t version, entryKind;
+  uint64_t entryKey;
+
+  return in && in.read(magic, 4) && std::equal(magic, magic + 4, MAGIC) &&
+         readValue(in, version) && version == CACHE_VERSION &&
+         readValue(in, entryKind) && entryKind == kind &&
+         readValue(in, entryKey) && entryKey == key.value();
+}
+
+// writes the entry through a temporary file, 'payload' writes the body
+static bool writeEntry(const std::string &directory, const std::string &path,
+                       const CacheKey &key, const EntryKind kind,
+                       const std::function<void(std::ostream &)> &payload) {
+
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+
+  // unique per process and thread, several runs may store the same key
+  const std::string temporary = path + "." +
+    std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) +
+    "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) +
+    ".tmp";
+
+  {
+    std::ofstream out(temporary, std::ios::binary);
+
+    out.write(MAGIC, 4);
+    writeValue(out, CACHE_VERSION);
+    writeValue<uint32_t>(out, kind);
+    writeValue(out, key.value());
+
+    payload(out);
+
+    if (!out) {
+      out.close();
+      std::filesystem::remove(temporary, error);
+      return false;
+    }
+  }
+
+  std::filesystem::rename(temporary, path, error);
+
+  if (error) std::filesystem::remove(temporary, error);
+
+  return !error;
+}
+
+bool PlanCache::loadPoints(const CacheKey &key, PointGrid &grid,
+                           std::vector<unsigned char> &densityPoints) const {
+
+  if (!enabled()) return false;
+
+  std::ifstream in;
+
+  return openEntry(in, path(key, "points"), key, ENTRY_POINTS) &&
+         grid.read(in) && readArray(in, densityPoints) &&
+         (int)densityPoints.size() == grid.size();
+}
+
+bool PlanCache::storePoints(const CacheKey &key, const PointGrid &grid,
+                            const std::vector<unsigned char> &densityPoints) const {
+
+  if (!enabled()) return false;
+
+  return writeEntry(directory, path(key, "points"), key, ENTRY_POINTS,
+                    [&](std::ostream &out) {
+    grid.write(out);
+    writeArray(out, densityPoints);
+  });
+}
+
+bool PlanCache::loadPlan(const CacheKey &key, PlanResult &result) const {
+
+  if (!enabled()) return false;
+
+  std::ifstream in;
+  std::vector<unsigned char> isoff;
+
+  bool ok = openEntry(in, path(key, "plan"), key, ENTRY_PLAN) &&
+            readValue(in, result.start) && readValue(in, result.scr) &&
+            readValue(in, result.rmsError) && readValue(in, result.offPercent) &&
+            readValue(in, result.score) && readArray(in, result.spt) &&
+            readArray(in, result.tree) && readArray(in, result.path) && readArray(in, result.graph) &&
+            readArray(in, isoff) && isoff.size() == result.graph.size();
+
+  if (ok) result.isoff.assign(isoff.begin(), isoff.end());
+
+  return ok;
+}
+
+bool PlanCache::storePlan(const CacheKey &key, const PlanResult &result) const {
+
+  if (!enabled()) return false;
+
+  // vector<bool> has no bytes of its own to write
+  std::vector<unsigned char> isoff(result.isoff.begin(), result.isoff.end());
+
+  return writeEntry(directory, path(key, "plan"), key, ENTRY_PLAN,
+                    [&](std::ostream &out) {
+    writeValue(out, result.start);
+    writeValue(out, result.scr);
+    writeValue(out, result.rmsError);
+    writeValue(out, result.offPercent);
+    writeValue(out, result.score);
+    writeArray(out, result.spt);
+    writeArray(out, result.tree);
+    writeArray(out, result.path);
+    writeArray(out, result.graph);
+    writeArray(out, isoff);
+  });
+}
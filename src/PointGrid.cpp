@@ -0,0 +1,135 @@
+#include "PointGrid.h"
+#include "BinaryIO.h"
+
+#include <algorithm>
+#include <cmath>
+
+PointGrid::PointGrid(const std::vector<vec2> &points, const float cellSize) {
+  build(points, cellSize);
+}
+
+void PointGrid::build(const std::vector<vec2> &points, const float cellSize) {
+
+  this->points = points;
+  this->cellSize = cellSize;
+
+  cellStart.clear();
+  cellIds.clear();
+  cellPoints.clear();
+
+  if (points.empty()) {
+    cols = rows = 0;
+    origin = vec2(0.0f, 0.0f);
+    return;
+  }
+
+  // bounds of the point set
+  vec2 lo = points[0];
+  vec2 hi = points[0];
+
+  for (const auto &p : points) {
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+
+  origin = vec2(std::floor(lo.x / cellSize), std::floor(lo.y / cellSize)) * cellSize;
+  cols = (int)std::floor((hi.x - origin.x) / cellSize) + 1;
+  rows = (int)std::floor((hi.y - origin.y) / cellSize) + 1;
+
+  // counting sort of the points by cell
+  std::vector<int> cell(points.size());
+  cellStart.assign(cols * rows + 1, 0);
+
+  for (size_t i = 0; i < points.size(); ++i) {
+    cell[i] = cellY(points[i].y) * cols + cellX(points[i].x);
+    cellStart[cell[i] + 1]++;
+  }
+
+  for (int c = 0; c < cols * rows; ++c)
+    cellStart[c + 1] += cellStart[c];
+
+  cellIds.resize(points.size());
+  cellPoints.resize(points.size());
+
+  std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+
+  for (size_t i = 0; i < points.size(); ++i) {
+    int slot = next[cell[i]]++;
+    cellIds[slot] = i;
+    cellPoints[slot] = points[i];
+  }
+}
+
+int PointGrid::cellX(float x) const {
+  int cx = (int)std::floor((x - origin.x) / cellSize);
+  return std::min(std::max(cx, 0), cols - 1);
+}
+
+int PointGrid::cellY(float y) const {
+  int cy = (int)std::floor((y - origin.y) / cellSize);
+  return std::min(std::max(cy, 0), rows - 1);
+}
+
+void PointGrid::query(const vec2 &center, const float radius,
+                      std::vector<int> &out, const float minRadius) const {
+
+  out.clear();
+
+  if (points.empty()) return;
+
+  // compare squared distances, no square roots in the inner loop
+  const float r2 = radius * radius;
+  const float m2 = minRadius * minRadius;
+
+  const int x0 = cellX(center.x - radius);
+  const int x1 = cellX(center.x + radius);
+  const int y0 = cellY(center.y - radius);
+  const int y1 = cellY(center.y + radius);
+
+  for (int cy = y0; cy <= y1; ++cy) {
+    // cells of a row are adjacent, so scan the whole row span in one go
+    const int start = cellStart[cy * cols + x0];
+    const int end = cellStart[cy * cols + x1 + 1];
+
+    for (int s = start; s < end; ++s) {
+      vec2 d = cellPoints[s] - center;
+      float d2 = d.x * d.x + d.y * d.y;
+
+      if (d2 <= r2 && d2 >= m2)
+        out.push_back(cellIds[s]);
+    }
+  }
+}
+
+void PointGrid::write(std::ostream &out) const {
+
+  writeValue(out, cellSize);
+  writeValue(out, cols);
+  writeValue(out, rows);
+  writeValue(out, origin);
+
+  writeArray(out, points);
+  writeArray(out, cellStart);
+  writeArray(out, cellIds);
+  writeArray(out, cellPoints);
+}
+
+bool PointGrid::read(std::istream &in) {
+
+  bool ok = readValue(in, cellSize) && readValue(in, cols) &&
+            readValue(in, rows) && readValue(in, origin) &&
+            readArray(in, points) && readArray(in, cellStart) &&
+            readArray(in, cellIds) && readArray(in, cellPoints);
+
+  // the arrays have to fit together, query trusts them
+  const size_t n = points.size();
+
+  ok = ok && cols >= 0 && rows >= 0 &&
+       cellIds.size() == n && cellPoints.size() == n &&
+       cellStart.size() == (n == 0 ? 0 : (size_t)cols * rows + 1) &&
+       (n == 0 || cellStart.back() == (int)n);
+
+  if (!ok) build(std::vector<vec2>(), 1.0f);
+
+  return ok;
+}
@@ -0,0 +1,274 @@
+#include "PoissonSampler.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+// genPoints puts about INFLATE * (255 - intensity) / 255 points on a pixel
+static const float INFLATE = 1.5f;
+
+// points per unit area of poisson disk samples with spacing r are about
+// PACKING / r^2, matched against the counts of genPoints on the sample maps
+static const float PACKING = 0.56f;
+
+// candidates tried around a point before it is retired (Bridson's k)
+static const int ATTEMPTS = 30;
+
+// size of the blocks a seed is thrown into, so that every patch of non zero
+// density gets sampled, not just the one the first seed landed in
+static const int SEED_BLOCK = 4;
+
+// random streams of the tiles, see Random.h
+static const uint64_t POISSON_STREAM = 2ull << 32;
+
+bool parsePointSampler(const std::string &name, PointSampler &sampler) {
+
+  if (name == "grid") sampler = SAMPLER_GRID;
+  else if (name == "poisson") sampler = SAMPLER_POISSON;
+  else if (name == "cvt") sampler = SAMPLER_CVT;
+  else if (name == "quadtree") sampler = SAMPLER_QUADTREE;
+  else return false;
+
+  return true;
+}
+
+PoissonSampler::PoissonSampler(Image *densityMap) {
+
+  width = densityMap->getWidth();
+  height = densityMap->getHeight();
+
+  density.resize(width * height);
+  intensity.resize(width * height);
+
+  float maxDensity = 0.0f;
+  float minDensity = std::numeric_limits<float>::max();
+
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      pixel current = densityMap->getpixel(h, w);
+
+      // the same mapping as genPoints
+      float I = (current.r / 2) + 128;
+      float d = INFLATE * (255.0f - I) / 255.0f;
+
+      intensity[h * width + w] = I;
+      density[h * width + w] = d;
+
+      if (d > 0.0f) {
+        maxDensity = std::max(maxDensity, d);
+        minDensity = std::min(minDensity, d);
+      }
+    }
+  }
+
+  if (maxDensity == 0.0f) maxDensity = minDensity = 1.0f;
+
+  minRadius = std::sqrt(PACKING / maxDensity);
+  maxRadius = std::sqrt(PACKING / minDensity);
+
+  // no point may see past the tile next to its own
+  tileSize = std::max(32.0f, std::ceil(maxRadius));
+  tileCols = std::max(1, (int)std::ceil(width / tileSize));
+  tileRows = std::max(1, (int)std::ceil(height / tileSize));
+
+  cellSize = minRadius / std::sqrt(2.0f);
+  cols = (int)std::ceil(width / cellSize) + 1;
+  rows = (int)std::ceil(height / cellSize) + 1;
+}
+
+float PoissonSampler::densityAt(const vec2 &p) const {
+
+  // pixel centres sit at +0.5
+  float x = std::min(std::max(p.x - 0.5f, 0.0f), width - 1.0f);
+  float y = std::min(std::max(p.y - 0.5f, 0.0f), height - 1.0f);
+
+  int x0 = (int)x, y0 = (int)y;
+  int x1 = std::min(x0 + 1, width - 1);
+  int y1 = std::min(y0 + 1, height - 1);
+
+  float fx = x - x0, fy = y - y0;
+
+  float top = density[y0 * width + x0] * (1 - fx) + density[y0 * width + x1] * fx;
+  float bot = density[y1 * width + x0] * (1 - fx) + density[y1 * width + x1] * fx;
+
+  return top * (1 - fy) + bot * fy;
+}
+
+float PoissonSampler::radiusAt(const float d) const {
+  return std::min(std::sqrt(PACKING / d), maxRadius);
+}
+
+bool PoissonSampler::tryAdd(const vec2 &p, const float radius) {
+
+  const float r2 = radius * radius;
+
+  const int cx = (int)(p.x / cellSize);
+  const int cy = (int)(p.y / cellSize);
+  const int reach = (int)std::ceil(radius / cellSize);
+
+  for (int y = std::max(cy - reach, 0); y <= std::min(cy + reach, rows - 1); ++y) {
+    for (int x = std::max(cx - reach, 0); x <= std::min(cx + reach, cols - 1); ++x) {
+      if (!occupied[y * cols + x]) continue;
+
+      vec2 d = cellPoint[y * cols + x] - p;
+      if (d.x * d.x + d.y * d.y < r2) return false;
+    }
+  }
+
+  occupied[cy * cols + cx] = 1;
+  cellPoint[cy * cols + cx] = p;
+
+  return true;
+}
+
+void PoissonSampler::sampleTile(const int tx, const int ty,
+                                std::vector<vec2> &out) {
+
+  seedThreadRandom(POISSON_STREAM + ty * tileCols + tx);
+  Xoshiro256 &g = threadRandom();
+
+  const float x0 = tx * tileSize;
+  const float y0 = ty * tileSize;
+  const float x1 = std::min(x0 + tileSize, (float)width);
+  const float y1 = std::min(y0 + tileSize, (float)height);
+
+  auto inside = [&](const vec2 &p) {
+    return p.x >= x0 && p.x < x1 && p.y >= y0 && p.y < y1;
+  };
+
+  std::vector<vec2> active;
+
+  auto place = [&](const vec2 &p) {
+    float d = densityAt(p);
+
+    if (d <= 0.0f || !tryAdd(p, radiusAt(d))) return false;
+
+    active.push_back(p);
+    out.push_back(p);
+    return true;
+  };
+
+  for (float sy = y0; sy < y1; sy += SEED_BLOCK) {
+    for (float sx = x0; sx < x1; sx += SEED_BLOCK) {
+      vec2 seed(sx + g.uniform() * SEED_BLOCK, sy + g.uniform() * SEED_BLOCK);
+
+      if (!inside(seed) || !place(seed)) continue;
+
+      // grow out of the seed until nothing more fits
+      while (!active.empty()) {
+        int i = g.below(active.size());
+        vec2 a = active[i];
+
+        float r = radiusAt(std::max(densityAt(a), 1e-6f));
+        bool found = false;
+
+        for (int k = 0; k < ATTEMPTS && !found; ++k) {
+          float theta = g.uniform() * 2.0 * PI;
+          float dist = r * (1.0f + g.uniform());
+
+          vec2 p = a + dist * vec2(std::cos(theta), std::sin(theta));
+
+          found = inside(p) && place(p);
+        }
+
+        // retire 'a'
+        if (!found) {
+          active[i] = active.back();
+          active.pop_back();
+        }
+      }
+    }
+  }
+}
+
+std::vector<vec2> PoissonSampler::sample(
+  std::vector<unsigned char> &densityPoints,
+  int numThreads) {
+
+  occupied.assign(cols * rows, 0);
+  cellPoint.assign(cols * rows, vec2(0.0f, 0.0f));
+
+  const int numTiles = tileCols * tileRows;
+  std::vector<std::vector<vec2>> tilePoints(numTiles);
+
+  if (numThreads <= 0)
+    numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  // four phases, one per colour, tiles of one colour go in parallel
+  for (int phase = 0; phase < 4; ++phase) {
+    std::vector<int> tiles;
+
+    for (int ty = phase / 2; ty < tileRows; ty += 2)
+      for (int tx = phase % 2; tx < tileCols; tx += 2)
+        tiles.push_back(ty * tileCols + tx);
+
+    std::atomic<int> next(0);
+
+    auto worker = [&]() {
+      // leave the thread's own generator as it was
+      Xoshiro256 saved = threadRandom();
+
+      for (int i = next++; i < (int)tiles.size(); i = next++)
+        sampleTile(tiles[i] % tileCols, tiles[i] / tileCols,
+                   tilePoints[tiles[i]]);
+
+      threadRandom() = saved;
+    };
+
+    std::vector<std::thread> pool;
+
+    for (int t = 1; t < std::min(numThreads, (int)tiles.size()); ++t)
+      pool.push_back(std::thread(worker));
+
+    worker();
+
+    for (auto &t : pool)
+      t.join();
+  }
+
+  // gather the tiles in a fixed order
+  std::vector<vec2> points;
+
+  for (auto &tile : tilePoints) {
+    for (auto &p : tile) {
+      points.push_back(p);
+      densityPoints.push_back(intensity[(int)p.y * width + (int)p.x]);
+    }
+  }
+
+  return points;
+}
+
+void PoissonSampler::sample(PointGrid &grid, const float gridCellSize,
+                            std::vector<unsigned char> &densityPoints,
+                            int numThreads) {
+
+  grid.build(sample(densityPoints, numThreads), gridCellSize);
+}
+
+int PoissonSampler::relax(std::vector<vec2> &points,
+                          std::vector<unsigned char> &densityPoints,
+                          const CVTParams &params) const {
+
+  // a CVT puts points about weight^(1/2) dense, so weigh by density^2
+  std::vector<float> weights(density.size());
+
+  for (size_t i = 0; i < density.size(); ++i)
+    weights[i] = density[i] * density[i];
+
+  int iterations = centroidalVoronoi(points, weights, width, height, params);
+
+  densityPoints.clear();
+
+  for (auto &p : points) {
+    int w = std::min(std::max((int)p.x, 0), width - 1);
+    int h = std::min(std::max((int)p.y, 0), height - 1);
+
+    densityPoints.push_back(intensity[h * width + w]);
+  }
+
+  return iterations;
+}
@@ -0,0 +1,215 @@
+#include "QuadtreeSampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+// intensities run from 128 (densest) to 255 (no points), see genPoints
+static const float RANGE = 127.0f;
+
+QuadtreeSampler::QuadtreeSampler(Image *densityMap,
+                                 const QuadtreeParams &params)
+  : densityMap(densityMap), params(params) {
+
+  width = densityMap->getWidth();
+  height = densityMap->getHeight();
+
+  // a finest block holds at most one point however dark it is, so quadrants
+  // the size of one are never split and the pyramid needs nothing finer
+  blockSize = 1;
+  while (2 * blockSize * params.mmPerPixel <= params.spacing) blockSize *= 2;
+
+  int side = blockSize;
+  while (side < std::max(width, height)) side *= 2;
+
+  rootSize = side;
+}
+
+void QuadtreeSampler::buildPyramid() {
+
+  std::vector<int> levelRows;
+  size_t total = 0;
+
+  for (int side = blockSize; ; side *= 2) {
+    const int cols = (width + side - 1) / side;
+    const int rows = (height + side - 1) / side;
+
+    levelStart.push_back(total);
+    levelCols.push_back(cols);
+    levelRows.push_back(rows);
+    total += (size_t)cols * rows;
+
+    if (side >= rootSize) break;
+  }
+
+  pyramid.assign(total, Block{0, 0, 0});
+
+  // the finest level straight from the pixels, a row at a time
+  for (int h = 0; h < height; ++h) {
+    Block *row = &pyramid[(size_t)(h / blockSize) * levelCols[0]];
+
+    for (int w = 0; w < width; ++w) {
+      const uint64_t red = densityMap->getpixel(h, w).r;
+
+      Block &b = row[w / blockSize];
+      b.sum += red;
+      b.squares += red * red;
+      ++b.pixels;
+    }
+  }
+
+  // every other one from the (up to) four blocks below each of its own
+  for (size_t l = 1; l < levelStart.size(); ++l) {
+    const Block *below = &pyramid[levelStart[l - 1]];
+    Block *level = &pyramid[levelStart[l]];
+
+    for (int r = 0; r < levelRows[l - 1]; ++r) {
+      for (int c = 0; c < levelCols[l - 1]; ++c) {
+        const Block &child = below[(size_t)r * levelCols[l - 1] + c];
+
+        Block &b = level[(size_t)(r / 2) * levelCols[l] + c / 2];
+        b.sum += child.sum;
+        b.squares += child.squares;
+        b.pixels += child.pixels;
+      }
+    }
+  }
+}
+
+const QuadtreeSampler::Block &QuadtreeSampler::blockOf(const Node &node) const {
+
+  // the root is the one block of the last level, each level down halves it
+  const int top = (int)levelStart.size() - 1;
+  const int level = std::max(top - node.depth, 0);
+  const int side = blockSize << level;
+
+  const int col = (int)node.x / side, row = (int)node.y / side;
+
+  return pyramid[levelStart[level] + (size_t)row * levelCols[level] + col];
+}
+
+unsigned char QuadtreeSampler::intensityAt(const vec2 &p) {
+
+  int w = std::min(std::max((int)p.x, 0), width - 1);
+  int h = std::min(std::max((int)p.y, 0), height - 1);
+
+  // the same mapping as genPoints
+  return (densityMap->getpixel(h, w).r / 2) + 128;
+}
+
+bool QuadtreeSampler::expectedPoints(const Node &node, float &expected) {
+
+  // the part of the quadrant on the map
+  const float x0 = std::max(node.x, 0.0f);
+  const float y0 = std::max(node.y, 0.0f);
+  const float x1 = std::min(node.x + node.size, (float)width);
+  const float y1 = std::min(node.y + node.size, (float)height);
+
+  if (x0 >= x1 || y0 >= y1) return false;
+
+  // quadrants smaller than a block take the mean of the one they are in
+  const Block &block = blockOf(node);
+
+  const float intensity = block.sum / (float)block.pixels / 2 + 128;
+  const float perMM2 = (255.0f - intensity) / RANGE /
+                       (params.spacing * params.spacing);
+
+  const float mm = params.mmPerPixel;
+  expected = std::max(perMM2, 0.0f) * (x1 - x0) * (y1 - y0) * mm * mm;
+
+  return true;
+}
+
+bool QuadtreeSampler::splits(const Node &node, const float expected) {
+
+  if (node.depth >= params.maxDepth) return false;
+  if (expected > params.maxLeafPoints) return true;
+
+  // a leaf is sampled at one density, not worth it for less than a point
+  if (expected <= 1.0f || node.size < blockSize) return false;
+
+  const Block &block = blockOf(node);
+
+  const double mean = block.sum / (double)block.pixels;
+  const double variance = block.squares / (double)block.pixels - mean * mean;
+
+  // intensity is half the red channel
+  const float deviation = std::sqrt(std::max(variance, 0.0)) / 2;
+
+  return deviation > params.maxDeviation;
+}
+
+void QuadtreeSampler::sampleLeaf(const Node &node, const float expected) {
+
+  leafPoints.clear();
+
+  Xoshiro256 &g = threadRandom();
+
+  // round up with the probability of the fraction, so the count is right on
+  // average however the map is cut
+  int count = (int)expected;
+  if (g.uniform() < expected - count) ++count;
+
+  if (count == 0) return;
+
+  const float x0 = std::max(node.x, 0.0f);
+  const float y0 = std::max(node.y, 0.0f);
+  const float x1 = std::min(node.x + node.size, (float)width);
+  const float y1 = std::min(node.y + node.size, (float)height);
+
+  // one point in each of 'count' strata of a side x side grid
+  const int side = (int)std::ceil(std::sqrt((float)count));
+
+  strata.resize(side * side);
+
+  for (int i = 0; i < side * side; ++i)
+    strata[i] = i;
+
+  // first 'count' of a fisher-yates shuffle
+  for (int i = 0; i < count; ++i)
+    std::swap(strata[i], strata[i + g.below(side * side - i)]);
+
+  // row by row within the leaf
+  std::sort(strata.begin(), strata.begin() + count);
+
+  const float sw = (x1 - x0) / side, sh = (y1 - y0) / side;
+
+  for (int i = 0; i < count; ++i) {
+    const int sx = strata[i] % side, sy = strata[i] / side;
+
+    leafPoints.push_back(vec2(x0 + (sx + g.uniform()) * sw,
+                              y0 + (sy + g.uniform()) * sh));
+  }
+}
+
+std::vector<vec2> QuadtreeSampler::sample(
+  std::vector<unsigned char> &densityPoints) {
+
+  std::vector<vec2> points;
+
+  generate([&](const vec2 &p) {
+    points.push_back(p);
+    densityPoints.push_back(intensityAt(p));
+  });
+
+  return points;
+}
+
+std::vector<vec2> QuadtreeSampler::sample(
+  std::vector<unsigned char> &densityPoints,
+  const float x0, const float y0, const float x1, const float y1) {
+
+  std::vector<vec2> points;
+
+  generate([&](const vec2 &p) {
+    points.push_back(p);
+    densityPoints.push_back(intensityAt(p));
+  }, x0, y0, x1, y1);
+
+  return points;
+}
+
+void QuadtreeSampler::sample(PointGrid &grid, const float gridCellSize,
+                             std::vector<unsigned char> &densityPoints) {
+
+  grid.build(sample(densityPoints), gridCellSize);
+}
@@ -0,0 +1,69 @@
+#include "Random.h"
+
+#include <atomic>
+
+void Xoshiro256::seed(uint64_t seed) {
+
+  // splitmix64, never leaves the state all zero
+  for (int i = 0; i < 4; ++i) {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    s[i] = z ^ (z >> 31);
+  }
+}
+
+static std::atomic<uint64_t> globalSeed(0);
+
+// bumped on every setRandomSeed, so threads know to restart their generator
+static std::atomic<unsigned int> generation(0);
+
+// next stream to hand out to a thread
+static std::atomic<uint64_t> nextStream(0);
+
+struct ThreadRandom {
+  Xoshiro256 generator;
+  uint64_t stream;
+  unsigned int generation;
+
+  ThreadRandom() : stream(nextStream++), generation(0) {
+    restart();
+  }
+
+  void restart() {
+    generation = ::generation;
+
+    // mix the stream into the seed, splitmix spreads it over the state
+    generator.seed(globalSeed ^ (stream * 0xd1b54a32d192ed03ull));
+  }
+};
+
+static ThreadRandom& threadState() {
+  static thread_local ThreadRandom state;
+  return state;
+}
+
+void setRandomSeed(uint64_t seed) {
+  globalSeed = seed;
+  generation++;
+}
+
+uint64_t getRandomSeed() {
+  return globalSeed;
+}
+
+Xoshiro256& threadRandom() {
+  ThreadRandom &state = threadState();
+
+  if (state.generation != generation)
+    state.restart();
+
+  return state.generator;
+}
+
+void seedThreadRandom(uint64_t stream) {
+  ThreadRandom &state = threadState();
+
+  state.stream = stream;
+  state.restart();
+}
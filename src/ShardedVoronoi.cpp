@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include "ShardedVoronoi.h"
+
+// below this many sites per strip one sweep beats sweeping the margins twice
+static const int MIN_STRIP_SITES = 4096;
+
+// first guess at the margin, in mean site spacings of the strip
+static const double GUARD = 3.0;
+
+ShardedVoronoi::ShardedVoronoi(int numThreads) : numThreads(numThreads) {
+
+  if (this->numThreads <= 0)
+    this->numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+void ShardedVoronoi::buildStrip(const int s, const std::vector<int> &order,
+                                const int first, const int last,
+                                const float *xValues, const float *yValues,
+                                const float box[4]) {
+
+  const int n = order.size();
+  VoronoiDiagramGenerator &vdg = *generators[s];
+
+  auto xOf = [&](const int k) { return (double)xValues[order[k]]; };
+
+  const double lo = xOf(first), hi = xOf(last - 1);
+  const int owned = last - first;
+
+  double spacing = std::sqrt(std::max(hi - lo, 1e-6) *
+                             std::max((double)box[3] - box[2], 1e-6) / owned);
+
+  // sites with x in [a, b] are swept
+  double a = lo - GUARD * spacing, b = hi + GUARD * spacing;
+
+  std::vector<float> xs, ys;
+  std::vector<int> cellStart;
+  std::vector<Point> cellCorners;
+
+  int ia, ib;
+
+  while (true) {
+    // the sites in [a, b] are a run of 'order'
+    ia = std::lower_bound(order.begin(), order.begin() + first, a,
+                          [&](const int i, const double v) { return xValues[i] < v; })
+         - order.begin();
+    ib = std::upper_bound(order.begin() + last, order.end(), b,
+                          [&](const double v, const int i) { return v < xValues[i]; })
+         - order.begin();
+
+    xs.resize(ib - ia);
+    ys.resize(ib - ia);
+
+    for (int k = ia; k < ib; ++k) {
+      xs[k - ia] = xValues[order[k]];
+      ys[k - ia] = yValues[order[k]];
+    }
+
+    vdg.generateVoronoi(xs.data(), ys.data(), ib - ia,
+                        box[0], box[1], box[2], box[3], 0);
+    vdg.getCells(cellStart, cellCorners);
+
+    // how far the circles of the corners of the owned cells reach
+    double reachLo = lo, reachHi = hi;
+
+    for (int k = first; k < last; ++k) {
+      const double sx = xValues[order[k]], sy = yValues[order[k]];
+      const int local = k - ia;
+
+      for (int i = cellStart[local]; i < cellStart[local + 1]; ++i) {
+        const double dx = cellCorners[i].x - sx, dy = cellCorners[i].y - sy;
+        const double r = std::sqrt(dx * dx + dy * dy);
+
+        reachLo = std::min(reachLo, cellCorners[i].x - r);
+        reachHi = std::max(reachHi, cellCorners[i].x + r);
+      }
+    }
+
+    // corners are rounded to floats, keep clear of them
+    const double slack = 1e-5 * (1.0 + std::max(std::fabs(reachLo), std::fabs(reachHi)));
+
+    // sites left of 'a' and right of 'b' were not swept
+    const bool leftOk = ia == 0 || reachLo - slack > a;
+    const bool rightOk = ib == n || reachHi + slack < b;
+
+    if (leftOk && rightOk) break;
+
+    // a cell only shrinks with more sites, so its circles do too: sweeping
+    // what they reach now is enough, short of rounding
+    if (!leftOk) a = std::min(a - spacing, reachLo - 2 * slack);
+    if (!rightOk) b = std::max(b + spacing, reachHi + 2 * slack);
+  }
+
+  std::vector<int> &start = stripStart[s];
+  std::vector<Point> &corners = stripCorners[s];
+
+  start.assign(1, 0);
+  corners.clear();
+
+  for (int k = first; k < last; ++k) {
+    const int local = k - ia;
+
+    corners.insert(corners.end(), cellCorners.begin() + cellStart[local],
+                   cellCorners.begin() + cellStart[local + 1]);
+    start.push_back(corners.size());
+  }
+}
+
+void ShardedVoronoi::generateCells(const float *xValues, const float *yValues,
+                                   const int numPoints,
+                                   const float minX, const float maxX,
+                                   const float minY, const float maxY,
+                                   std::vector<int> &cellStart,
+                                   std::vector<Point> &cellCorners) {
+
+  const int n = numPoints;
+
+  cellStart.assign(n + 1, 0);
+  cellCorners.clear();
+
+  if (n == 0) return;
+
+  const float box[4] = {std::min(minX, maxX), std::max(minX, maxX),
+                        std::min(minY, maxY), std::max(minY, maxY)};
+
+  const int numStrips = std::max(1, std::min(numThreads, n / MIN_STRIP_SITES));
+
+  while ((int)generators.size() < numStrips)
+    generators.push_back(std::unique_ptr<VoronoiDiagramGenerator>(new VoronoiDiagramGenerator));
+
+  stripStart.resize(numStrips);
+  stripCorners.resize(numStrips);
+
+  // sites by x, ties by index so the strips do not depend on the sort
+  std::vector<int> order(n);
+
+  for (int i = 0; i < n; ++i)
+    order[i] = i;
+
+  std::sort(order.begin(), order.end(), [&](const int i, const int j) {
+    return xValues[i] < xValues[j] || (xValues[i] == xValues[j] && i < j);
+  });
+
+  std::atomic<int> nextStrip(0);
+
+  auto worker = [&]() {
+    for (int s = nextStrip++; s < numStrips; s = nextStrip++)
+      buildStrip(s, order, (long long)n * s / numStrips,
+                 (long long)n * (s + 1) / numStrips, xValues, yValues, box);
+  };
+
+  std::vector<std::thread> pool;
+
+  for (int t = 1; t < numStrips; ++t)
+    pool.push_back(std::thread(worker));
+
+  worker();
+
+  for (auto &t : pool)
+    t.join();
+
+  // stitch the strips back together in site order
+  for (int s = 0; s < numStrips; ++s) {
+    const int first = (long long)n * s / numStrips;
+
+    for (int k = 0; k + 1 < (int)stripStart[s].size(); ++k)
+      cellStart[order[first + k] + 1] = stripStart[s][k + 1] - stripStart[s][k];
+  }
+
+  for (int i = 0; i < n; ++i)
+    cellStart[i + 1] += cellStart[i];
+
+  cellCorners.resize(cellStart[n]);
+
+  for (int s = 0; s < numStrips; ++s) {
+    const int first = (long long)n * s / numStrips;
+
+    for (int k = 0; k + 1 < (int)stripStart[s].size(); ++k)
+      std::copy(stripCorners[s].begin() + stripStart[s][k],
+                stripCorners[s].begin() + stripStart[s][k + 1],
+                cellCorners.begin() + cellStart[order[first + k]]);
+  }
+}
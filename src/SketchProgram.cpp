@@ -4,6 +4,9 @@
 
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <cmath>
+#include <random>
 #include <string>
 #include <iostream>
 
@@ -434,6 +437,43 @@ void SketchProgram::ReadParameters(const char* paramFile)
     defaultDensityMap = args[9];
     zoneMapName = args[11];
 
+    // Optional stitch planning parameters, found by name so any of them can be left out.
+    for (size_t i = 12; i + 1 < args.size(); i += 2)
+    {
+        const std::string& name = args[i];
+        const std::string& value = args[i + 1];
+
+        if (name == "stitchStarts=")
+            pStitchStarts = std::max(1, std::stoi(value));
+        else if (name == "stitchScore=")
+        {
+            if (!parsePlanScore(value, pStitchScore))
+                std::cout << "Unknown stitch score \"" << value << "\", using scr\n";
+        }
+        else if (name == "pointSampler=")
+        {
+            if (!parsePointSampler(value, pPointSampler))
+                std::cout << "Unknown point sampler \"" << value << "\", using grid\n";
+        }
+        else if (name == "stitchSeed=")
+        {
+            pHasStitchSeed = true;
+            pStitchSeed = std::stoull(value);
+        }
+        else if (name == "mmPerPixel=")
+            pMmPerPixel = std::stof(value);
+        else if (name == "stitchSpacing=")
+            pStitchSpacing = std::stof(value);
+        else
+            std::cout << "Unknown parameter \"" << name << "\", ignored\n";
+    }
+
+    // A design 100 mm wide unless told otherwise, as it always was.
+    if (!(pMmPerPixel > 0.0f))
+        pMmPerPixel = 100.0f / pWidth;
+    if (!(pStitchSpacing > 0.0f))
+        pStitchSpacing = QuadtreeParams().spacing;
+
     // Print parameters so the user can verify they are what they wanted.
     std::cout << "Initializing with the following parameters: \n";
     std::cout << "Screen width: " << pWidth << "\n";
@@ -442,6 +482,15 @@ void SketchProgram::ReadParameters(const char* paramFile)
     std::cout << "Static normal map: " << defaultNormalMap << "\n";
     std::cout << "Static density map: " << defaultDensityMap << "\n";
     std::cout << "Zone map: " << zoneMapName << "\n";
+    std::cout << "Stitch starts: " << pStitchStarts << "\n";
+    const char* samplerNames[] = { "grid", "poisson", "cvt", "quadtree" };
+    std::cout << "Point sampler: " << samplerNames[pPointSampler] << "\n";
+    std::cout << "Millimetres per pixel: " << pMmPerPixel << "\n";
+    std::cout << "Stitch spacing (mm): " << pStitchSpacing << "\n";
+    if (pHasStitchSeed)
+        std::cout << "Stitch seed: " << pStitchSeed << "\n";
+    else
+        std::cout << "Stitch seed: new for every stitch\n";
 }
 
 void SketchProgram::ParseZoneMap(const std::string& filename)
@@ -496,6 +545,7 @@ void SketchProgram::ParseZoneMap(const std::string& filename)
 
     // NOW we read raw image data, and set zone information.
     std::vector<PixelRGB> uniqueColors;
+    std::unordered_map<int, int> zoneByColor;   // Packed rgb to zone, so lookups don't slow down with more zones.
     voronoiZonesByPixel.resize(screenWidth);
     PixelRGB whitePix = PixelRGB {255, 255, 255};
     for (int x = 0; x < screenWidth; x++)
@@ -512,29 +562,21 @@ void SketchProgram::ParseZoneMap(const std::string& filename)
             currPixel.b = static_cast<unsigned char>(pixels[index + 2]);
             alpha = (bytes >= 4) ? static_cast<unsigned char>(pixels[index + 3]) : 255;
 
-            bool isNewColor = true;
-
             if (PixelRGB::Equals(&currPixel, &whitePix) || alpha == 0)
             {
                 voronoiZonesByPixel[x][y] = 0;
                 continue;
             }
 
-            for (int i = 0; i < uniqueColors.size(); i++)
-            {
-                if (PixelRGB::Equals(&currPixel, &uniqueColors[i]))
-                {
-                    isNewColor = false;
-                    voronoiZonesByPixel[x][y] = i + 1;
-                    break;
-                }
-            }
-
-            if (isNewColor)
+            int colorKey = (currPixel.r << 16) | (currPixel.g << 8) | currPixel.b;
+            auto found = zoneByColor.find(colorKey);
+            if (found == zoneByColor.end())
             {
                 uniqueColors.push_back(currPixel);
-                voronoiZonesByPixel[x][y] = (int)uniqueColors.size();
+                found = zoneByColor.emplace(colorKey, (int)uniqueColors.size()).first;
             }
+
+            voronoiZonesByPixel[x][y] = found->second;
         }
     }
 
@@ -544,6 +586,7 @@ void SketchProgram::ParseZoneMap(const std::string& filename)
 
     std::cout << (int)uniqueColors.size() << std::endl;
 
+    // These don't allocate anything per pixel until the first point is placed in their zone.
     for (int i = 0; i < uniqueColors.size(); ++i)
     {
         std::unique_ptr<Layer> newLayer = std::make_unique<Layer>(screenWidth, screenHeight, i + 1);
@@ -553,12 +596,15 @@ void SketchProgram::ParseZoneMap(const std::string& filename)
     normalMapPixels = PixelRGB::CreateContiguous2DPixmap(screenHeight, screenWidth);
     densityMapPixels = PixelRGB::CreateContiguous2DPixmap(screenHeight, screenWidth);
 
+    for (auto& layer : layers)
+        layer->Set_OutputPixmaps(normalMapPixels, densityMapPixels);
 
-    for (int x = 0; x < screenWidth; ++x)
-        for (int y = 0; y < screenHeight; ++y)
+    // Row by row, so layers can keep their zones as runs of pixels.
+    for (int y = 0; y < screenHeight; ++y)
+        for (int x = 0; x < screenWidth; ++x)
         {
             int zone = voronoiZonesByPixel[x][y];
-            layers[zone]->Set_PixelRefs(x, y, &normalMapPixels[y][x], &densityMapPixels[y][x]);
+            layers[zone]->Set_InZone(x, y);
         }
 
 }
@@ -584,9 +630,7 @@ void SketchProgram::LoadDefaultMesh()
             int pixY = (int)pos[1];
             int zone = voronoiZonesByPixel[pixX][pixY];
 
-            if (layers[zone]->Get_IsEditable())
-                std::cout << "Spawning Point: x = " << x << ", y = " << y << "\n";
-            else
+            if (!layers[zone]->Get_IsEditable())
             {
                 std::cout << "Unable to spawn point: x = " << x << ", y = " << y << ", position is uneditable!" << "\n";
                 continue;
@@ -601,15 +645,12 @@ void SketchProgram::LoadDefaultMesh()
 
             Helpers::NormalMapDefaultColor(&defCol);
             std::shared_ptr<VoronoiPoint> newPoint = std::make_shared<VoronoiPoint>(pos, defCol, zone);
-            EmplaceVoronoiPoint(newPoint, false);
             newestPointID = newPoint->Get_ID();
             voronoiPoints[newestPointID] = std::move(newPoint);
         }
 
-    for (auto& layer : layers)
-    {
-        layer->UpdateLayerAll(true);
-    }
+    // All at once rather than point by point.
+    RebuildLayers();
 }
 
 void SketchProgram::CreateTextureFromPixelData(SDL_Texture*& text, void* pixels, int w, int h, int channels)
@@ -721,33 +762,40 @@ void SketchProgram::MoveSelectedPoints()
 
 void SketchProgram::RebuildMapNaive()
 {
-    for (auto& layer : layers)
-    {
-        layer->ClearData();
-    }
-
     std::cout << "Rebuilding map...\n";
-    int cnt = voronoiPoints.size();
-    int cur = 1;
+    RebuildLayers();
+
+    mainVecField->UpdateAll();
+        
+    std::cout << "Map Rebuilt!\n";
+}
+
+void SketchProgram::RebuildLayers()
+{
+    std::vector<std::vector<std::shared_ptr<VoronoiPoint>>> pointsByZone(layers.size());
     for (auto& vPt : voronoiPoints)
     {
-        EmplaceVoronoiPoint(vPt.second, false);
-        std::cout << "(" << cur++ << "/" <<  cnt << ") points placed\n";
+        pointsByZone[vPt.second->Get_VoronoiZone()].push_back(vPt.second);
     }
 
-    // These similar loops might seem silly, but rebuilding the map is already incredibly slow,
-    // so I threw this if statement at the top level like so to reduce slowdown
-    // from thousands of branches
-    std::cout << "Updating pixels...\n";
-    for (auto& layer : layers)
+    for (int zone = 0; zone < layers.size(); zone++)
     {
-        if (layer->Get_IsEditable())
-            layer->UpdateLayerAll(!voronoiPoints.empty());
-    }
+        if (!layers[zone]->Get_IsEditable())
+        {
+            layers[zone]->ClearData();
+            continue;
+        }
 
-    mainVecField->UpdateAll();
-        
-    std::cout << "Map Rebuilt!\n";
+        // Oldest first, so ties between equally close points go the same way as
+        // when the points were placed one by one.
+        std::vector<std::shared_ptr<VoronoiPoint>>& points = pointsByZone[zone];
+        std::sort(points.begin(), points.end(), [](const std::shared_ptr<VoronoiPoint>& a, const std::shared_ptr<VoronoiPoint>& b)
+        {
+            return a->Get_ID() < b->Get_ID();
+        });
+
+        layers[zone]->Rebuild(points);
+    }
 }
 
 void SketchProgram::RecolorSelectedPoints(SketchLine* followLine)
@@ -812,12 +860,44 @@ void SketchProgram::CreateStitchDiagram()
     unsigned char* pixels;
     PixelRGB** densityMap = nullptr;
 
-    width = 100;
-    height = 100;
+    // The planner links up points around QuadtreeParams().spacing pixels of its
+    // map apart, so a map pixel is as big as makes that the stitch spacing.
+    const float mapPixelMM = pStitchSpacing / QuadtreeParams().spacing;
+
+    // Grid sampler blocks stay about a centimetre of the design, and the map a
+    // whole number of them, as blocks past its edge get no points.
+    const int subgridSize = std::max(1, (int)std::lround(10.0f / mapPixelMM));
+
+    // Square like the window width, the legacy planner flips the normal map
+    // about its diagonal.
+    width = subgridSize * std::max(1, (int)std::lround(screenWidth * pMmPerPixel / mapPixelMM / subgridSize));
+    height = width;
     bytes = 3;
 
     std::unique_ptr<StitchResult> res = std::make_unique<StitchResult>(screenWidth, screenHeight, width, height, normalMapPixels, (densityMap == nullptr) ? densityMapPixels : densityMap);
-    if (res->CreateStitches(true))
+    res->Set_Scale(screenWidth * pMmPerPixel / width, pStitchSpacing, subgridSize);
+    res->Set_MultiStart(pStitchStarts, pStitchScore);
+    res->Set_PointSampler(pPointSampler);
+
+    // Without a seed in the parameters every stitch is rolled anew, so making
+    // it again can give a better one. The seed is printed to make it again.
+    uint64_t seed = pStitchSeed;
+    if (!pHasStitchSeed)
+    {
+        std::random_device device;
+        seed = ((uint64_t)device() << 32) ^ device()
+            ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+    std::cout << "Stitch seed: " << seed << "\n";
+    res->Set_Seed(seed, pHasStitchSeed);
+    res->Set_Previous(lastStitchPlan);
+    bool created = res->CreateStitches(true);
+
+    // Outlives the window of the stitch, the next one builds on it either way.
+    if (res->Get_PlanState() != nullptr)
+        lastStitchPlan = res->Get_PlanState();
+
+    if (created)
     {
         stitchResults.push_back(std::move(res));
     }
@@ -0,0 +1,181 @@
+#include "StitchExport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+bool writeStitchCSV(const std::string &filename,
+                    const std::vector<edge> &graph,
+                    const std::vector<bool> &isoff,
+                    const float width) {
+
+  std::ofstream data(filename);
+
+  if (!data) return false;
+
+  for (size_t i = 0; i < graph.size(); ++i) {
+    // mirror the plan into the hoop's frame
+    float x = width - graph[i].u.x;
+    float y = graph[i].u.y;
+
+    // on the first stitch, jump to the first stitch position instead of
+    // stitching across from the corner of the hoop
+    if (i == 0)
+      data << "\"*\", \"JUMP\", \"" << x << "\", \"" << y << "\", 1\n";
+
+    if (i == graph.size() - 1)
+      data << "\"*\", \"END\", \"" << x << "\", \"" << y << "\", 0\n";
+    else
+      data << "\"*\", \"STITCH\", \"" << x << "\", \"" << y << "\", "
+           << (isoff[i] ? 1 : 0) << "\n";
+  }
+
+  return (bool)data;
+}
+
+// DST works in units of 0.1 mm
+static const float DST_UNITS_PER_MM = 10.0f;
+
+// longest move a single DST record can hold along either axis
+static const int DST_MAX_MOVE = 121;
+
+// size of the DST header
+static const int DST_HEADER_SIZE = 512;
+
+// flags in the third byte of a DST record
+static const unsigned char DST_STITCH = 0x03;
+static const unsigned char DST_JUMP = 0x83;
+
+// encode a move of (dx, dy), both in [-121, 121], into a 3 byte record
+// each axis is written as balanced ternary digits of 81, 27, 9, 3 and 1
+static void encodeRecord(unsigned char *b, int dx, int dy, unsigned char flags) {
+
+  b[0] = b[1] = 0;
+  b[2] = flags;
+
+  if (dx > 40)  { b[2] |= 0x04; dx -= 81; }
+  if (dx < -40) { b[2] |= 0x08; dx += 81; }
+  if (dx > 13)  { b[1] |= 0x04; dx -= 27; }
+  if (dx < -13) { b[1] |= 0x08; dx += 27; }
+  if (dx > 4)   { b[0] |= 0x04; dx -= 9; }
+  if (dx < -4)  { b[0] |= 0x08; dx += 9; }
+  if (dx > 1)   { b[1] |= 0x01; dx -= 3; }
+  if (dx < -1)  { b[1] |= 0x02; dx += 3; }
+  if (dx > 0)   { b[0] |= 0x01; dx -= 1; }
+  if (dx < 0)   { b[0] |= 0x02; dx += 1; }
+
+  if (dy > 40)  { b[2] |= 0x20; dy -= 81; }
+  if (dy < -40) { b[2] |= 0x10; dy += 81; }
+  if (dy > 13)  { b[1] |= 0x20; dy -= 27; }
+  if (dy < -13) { b[1] |= 0x10; dy += 27; }
+  if (dy > 4)   { b[0] |= 0x20; dy -= 9; }
+  if (dy < -4)  { b[0] |= 0x10; dy += 9; }
+  if (dy > 1)   { b[1] |= 0x80; dy -= 3; }
+  if (dy < -1)  { b[1] |= 0x40; dy += 3; }
+  if (dy > 0)   { b[0] |= 0x80; dy -= 1; }
+  if (dy < 0)   { b[0] |= 0x40; dy += 1; }
+}
+
+// streams records to a DST file and keeps track of what the header needs
+class DSTWriter {
+private:
+  std::ofstream &out;
+  int x, y;              // current position in DST units
+  int minX, maxX, minY, maxY;
+
+public:
+  int records;
+
+  DSTWriter(std::ofstream &out) : out(out), x(0), y(0),
+                                  minX(0), maxX(0), minY(0), maxY(0),
+                                  records(0) {}
+
+  // move to (tx, ty), split into as many records as needed
+  void moveTo(int tx, int ty, unsigned char flags) {
+
+    int dx = tx - x;
+    int dy = ty - y;
+
+    int steps = (std::max(std::abs(dx), std::abs(dy)) + DST_MAX_MOVE - 1) /
+                DST_MAX_MOVE;
+
+    // spread the move evenly over the records
+    for (int s = 1; s <= steps; ++s) {
+      int nx = x + (tx - x) / (steps - s + 1);
+      int ny = y + (ty - y) / (steps - s + 1);
+
+      unsigned char b[3];
+      encodeRecord(b, nx - x, ny - y, flags);
+      out.write((const char*)b, 3);
+
+      x = nx; y = ny;
+      records++;
+
+      minX = std::min(minX, x); maxX = std::max(maxX, x);
+      minY = std::min(minY, y); maxY = std::max(maxY, y);
+    }
+  }
+
+  void end() {
+    const unsigned char b[3] = { 0x00, 0x00, 0xF3 };
+    out.write((const char*)b, 3);
+    records++;
+  }
+
+  void writeHeader(const std::string &label) {
+
+    char header[DST_HEADER_SIZE];
+    std::memset(header, ' ', DST_HEADER_SIZE);
+
+    int n = std::snprintf(header, DST_HEADER_SIZE,
+      "LA:%-16.16s\rST:%7d\rCO:%3d\r+X:%5d\r-X:%5d\r+Y:%5d\r-Y:%5d\r"
+      "AX:%c%5d\rAY:%c%5d\rMX:+%5d\rMY:+%5d\rPD:******\r\x1a",
+      label.c_str(), records, 0, maxX, -minX, maxY, -minY,
+      x < 0 ? '-' : '+', std::abs(x), y < 0 ? '-' : '+', std::abs(y), 0, 0);
+
+    // snprintf leaves a terminator behind, pad over it
+    header[n] = ' ';
+
+    out.seekp(0);
+    out.write(header, DST_HEADER_SIZE);
+  }
+};
+
+bool writeStitchDST(const std::string &filename,
+                    const std::vector<edge> &graph,
+                    const float width, const float height,
+                    const std::string &label,
+                    const float mmPerUnit) {
+
+  std::ofstream out(filename, std::ios::binary);
+
+  if (!out) return false;
+
+  // leave room for the header, it is filled in once the extents are known
+  char blank[DST_HEADER_SIZE];
+  std::memset(blank, ' ', DST_HEADER_SIZE);
+  out.write(blank, DST_HEADER_SIZE);
+
+  DSTWriter dst(out);
+
+  for (size_t i = 0; i < graph.size(); ++i) {
+    // same frame as the csv export, relative to the middle of the map
+    // rows grow downwards while DST y grows upwards
+    float x = (width - graph[i].u.x) - 0.5f * width;
+    float y = 0.5f * height - graph[i].u.y;
+
+    int tx = (int)std::lround(x * mmPerUnit * DST_UNITS_PER_MM);
+    int ty = (int)std::lround(y * mmPerUnit * DST_UNITS_PER_MM);
+
+    // jump to the first stitch position instead of stitching across to it
+    dst.moveTo(tx, ty, i == 0 ? DST_JUMP : DST_STITCH);
+  }
+
+  dst.end();
+  dst.writeHeader(label);
+
+  return (bool)out;
+}
@@ -0,0 +1,168 @@
+#include "StitchGrid.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+StitchGrid::StitchGrid(const vec2 &lo, const vec2 &hi, const float cellSize) :
+cellSize(cellSize), origin(lo)
+{
+  cols = std::max(1, (int)std::ceil((hi.x - lo.x) / cellSize));
+  rows = std::max(1, (int)std::ceil((hi.y - lo.y) / cellSize));
+
+  cells.resize(cols * rows);
+}
+
+int StitchGrid::cellX(float x) const {
+  int cx = (int)std::floor((x - origin.x) / cellSize);
+  return std::min(std::max(cx, 0), cols - 1);
+}
+
+int StitchGrid::cellY(float y) const {
+  int cy = (int)std::floor((y - origin.y) / cellSize);
+  return std::min(std::max(cy, 0), rows - 1);
+}
+
+// a little slack so segments running along a cell border land in both cells
+static const float BORDER_SLACK = 1e-4f;
+
+void StitchGrid::rowSpan(const vec2 &u, const vec2 &v, int &y0, int &y1) const {
+
+  const float eps = BORDER_SLACK * cellSize;
+
+  y0 = cellY(std::min(u.y, v.y) - eps);
+  y1 = cellY(std::max(u.y, v.y) + eps);
+}
+
+// take the part of the segment inside the row and the columns it covers
+void StitchGrid::columnSpan(const vec2 &u, const vec2 &v, int cy,
+                            int &x0, int &x1) const {
+
+  const float eps = BORDER_SLACK * cellSize;
+
+  const float ylo = std::min(u.y, v.y);
+  const float yhi = std::max(u.y, v.y);
+
+  float sy0 = std::max(ylo, origin.y + cy * cellSize - eps);
+  float sy1 = std::min(yhi, origin.y + (cy + 1) * cellSize + eps);
+
+  // the border rows also hold everything beyond the grid
+  if (cy == 0) sy0 = ylo;
+  if (cy == rows - 1) sy1 = yhi;
+
+  float xa, xb;
+
+  if (u.y == v.y) {
+    xa = u.x;
+    xb = v.x;
+  }
+  else {
+    float ta = (sy0 - u.y) / (v.y - u.y);
+    float tb = (sy1 - u.y) / (v.y - u.y);
+
+    xa = u.x + std::min(std::max(ta, 0.0f), 1.0f) * (v.x - u.x);
+    xb = u.x + std::min(std::max(tb, 0.0f), 1.0f) * (v.x - u.x);
+  }
+
+  x0 = cellX(std::min(xa, xb) - eps);
+  x1 = cellX(std::max(xa, xb) + eps);
+}
+
+void StitchGrid::add(const vec2 &u, const vec2 &v) {
+
+  const int id = stitches.size();
+  stitches.push_back(edge(u, v));
+
+  int y0, y1, x0, x1;
+  rowSpan(u, v, y0, y1);
+
+  for (int cy = y0; cy <= y1; ++cy) {
+    columnSpan(u, v, cy, x0, x1);
+
+    for (int cx = x0; cx <= x1; ++cx)
+      cells[cy * cols + cx].push_back(id);
+  }
+}
+
+int StitchGrid::findCrossing(const vec2 &u, const vec2 &v) const {
+
+  if (stitches.empty()) return -1;
+
+  int y0, y1, x0, x1;
+  rowSpan(u, v, y0, y1);
+
+  // a stitch may be seen in more than one cell, testing it twice is
+  // cheaper than keeping track of what was tested
+  for (int cy = y0; cy <= y1; ++cy) {
+    columnSpan(u, v, cy, x0, x1);
+
+    for (int cx = x0; cx <= x1; ++cx) {
+      for (int id : cells[cy * cols + cx]) {
+        const edge &stitch = stitches[id];
+
+        if (doIntersect(u, v, stitch.u, stitch.v))
+          return id;
+      }
+    }
+  }
+
+  return -1;
+}
+
+void StitchGrid::filterCrossing(const vec2 &u, const PointGrid &points,
+                                std::vector<int> &candidates) const {
+
+  if (stitches.empty() || candidates.empty()) return;
+
+  // box around all the candidate stitches
+  vec2 lo = u;
+  vec2 hi = u;
+
+  for (int id : candidates) {
+    lo = glm::min(lo, points.getPoint(id));
+    hi = glm::max(hi, points.getPoint(id));
+  }
+
+  // gather the stitches near the batch once
+  std::vector<int> nearby;
+
+  for (int cy = cellY(lo.y); cy <= cellY(hi.y); ++cy)
+    for (int cx = cellX(lo.x); cx <= cellX(hi.x); ++cx)
+      nearby.insert(nearby.end(), cells[cy * cols + cx].begin(),
+                    cells[cy * cols + cx].end());
+
+  std::sort(nearby.begin(), nearby.end());
+  nearby.erase(std::unique(nearby.begin(), nearby.end()), nearby.end());
+
+  // test every candidate against the gathered stitches, filtering in place
+  size_t kept = 0;
+
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const vec2 &v = points.getPoint(candidates[i]);
+
+    const vec2 clo = glm::min(u, v);
+    const vec2 chi = glm::max(u, v);
+
+    bool doesIntersect = false;
+
+    for (int id : nearby) {
+      const edge &stitch = stitches[id];
+
+      // cheap box rejection before the orientation tests
+      if (std::max(stitch.u.x, stitch.v.x) < clo.x ||
+          std::min(stitch.u.x, stitch.v.x) > chi.x ||
+          std::max(stitch.u.y, stitch.v.y) < clo.y ||
+          std::min(stitch.u.y, stitch.v.y) > chi.y)
+        continue;
+
+      if (doIntersect(u, v, stitch.u, stitch.v)) {
+        doesIntersect = true;
+        break;
+      }
+    }
+
+    if (!doesIntersect) candidates[kept++] = candidates[i];
+  }
+
+  candidates.resize(kept);
+}
@@ -0,0 +1,511 @@
+#include "StitchPlanner.h"
+#include "StitchGrid.h"
+#include "StitchCost.h"
+#include "utils.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <list>
+#include <thread>
+#include <unordered_map>
+
+// Image has no copy constructor, deep copy the pixels by hand
+static Image* copyImage(Image *image) {
+
+  Image *copy = new Image(image->getWidth(), image->getHeight(), 4);
+  copy->copyImage(image->getPixmap());
+
+  return copy;
+}
+
+// root of 'i' in the union-find 'root', halving the path on the way
+static int findRoot(std::vector<int> &root, int i) {
+
+  while (root[i] != i) {
+    root[i] = root[root[i]];
+    i = root[i];
+  }
+
+  return i;
+}
+
+bool parsePlanScore(const std::string &name, PlanScore &score) {
+
+  if (name == "scr") score = SCORE_SCR;
+  else if (name == "rms") score = SCORE_RMS_ERROR;
+  else if (name == "off") score = SCORE_OFF_PERCENT;
+  else return false;
+
+  return true;
+}
+
+bool parsePlanCost(const std::string &name, PlanCost &cost) {
+
+  if (name == "exact") cost = COST_EXACT;
+  else if (name == "table") cost = COST_TABLE;
+  else return false;
+
+  return true;
+}
+
+StitchPlanner::StitchPlanner(Image *normalMap, const std::vector<vec2> &points,
+                             const PlanParams &params) :
+params(params)
+{
+  this->normalMap = copyImage(normalMap);
+
+  normals = this->normalMap->interpretNormalMap();
+
+  // place points in a bin lattice, points are referred to by their index
+  grid.build(points, SUBREGION_SIZE);
+}
+
+StitchPlanner::StitchPlanner(Image *normalMap, const PointGrid &grid,
+                             const PlanParams &params) :
+grid(grid), params(params)
+{
+  this->normalMap = copyImage(normalMap);
+
+  normals = this->normalMap->interpretNormalMap();
+}
+
+StitchPlanner::~StitchPlanner() {
+  normalMap->destroy();
+  delete normalMap;
+}
+
+template <typename Pow>
+PlanResult StitchPlanner::planWith(const int start,
+                                   const PlanScore score) const {
+
+  PlanResult result;
+  result.start = start;
+
+  // this run's own copy of the normal map, gets reversed along the way
+  Image *map = copyImage(normalMap);
+
+  const int width = map->getWidth();
+  const int height = map->getHeight();
+
+  // stitches laid down so far, for the crossing checks
+  StitchGrid stitchGrid(vec2(0, 0), vec2(width, height), 5);
+
+  std::vector<edge> segments = this->segments;
+
+  DirectionCost<Pow> cost1(params.alpha1, params.beta1);
+  TurnCost<Pow> cost2(params.alpha2, params.beta2);
+
+  result.spt = map->dijkstra(start, grid, stitchGrid, normals, cost1, cost2,
+                             segments);
+
+  map->reverseNormalMap(result.spt, normals);
+
+  // fix jumps and get final graph
+  std::unordered_map<vec2, std::list<vec2>, HashVec> adj =
+    map->cleanup(normals, result.spt, cost1, grid, stitchGrid, segments);
+
+  finish(map, adj, score, result);
+
+  map->destroy();
+  delete map;
+
+  return result;
+}
+
+PlanResult StitchPlanner::plan(const int start, const PlanScore score) const {
+
+  if (params.cost == COST_TABLE)
+    return planWith<TablePow>(start, score);
+
+  return planWith<ExactPow>(start, score);
+}
+
+void StitchPlanner::finish(Image *map,
+                           std::unordered_map<vec2, std::list<vec2>, HashVec> &adj,
+                           const PlanScore score, PlanResult &result) const {
+
+  map->reverseNormalMap(adj, normals);
+
+  // every edge of the tree once, from its lower end
+  for (auto &e : adj) {
+    for (const vec2 &v : e.second) {
+      if (e.first.x < v.x || (e.first.x == v.x && e.first.y < v.y))
+        result.tree.push_back(edge(e.first, v));
+    }
+  }
+
+  // tree traversal for path generation
+  std::unordered_map<vec2, unsigned char, HashVec> densities;
+  map->genPath(adj, densities, result.path);
+
+  // convert path to edges
+  for (int i = 0; i < (int)result.path.size() - 2; ++i)
+    result.graph.push_back(edge(result.path[i], result.path[i + 1]));
+
+  // score the run every way we know
+  result.scr = Image::SCR(result.spt);
+
+  map->flagOff(result.isoff, result.graph, normals);
+
+  int off = std::count(result.isoff.begin(), result.isoff.end(), true);
+  result.offPercent = result.graph.empty() ? 0.0f :
+                      100.0f * off / (float)result.graph.size();
+
+  std::vector<pixel> original = normalMap->readImageIntoBuffer();
+  std::vector<pixel> reversed = map->readImageIntoBuffer();
+
+  pixel p = Image::RMSError(original, reversed);
+  result.rmsError = (p.r + p.g + p.b) / 3.0f;
+
+  switch (score) {
+    case SCORE_SCR:
+      result.score = std::fabs(result.scr - params.targetSCR);
+      break;
+    case SCORE_RMS_ERROR:
+      result.score = result.rmsError;
+      break;
+    case SCORE_OFF_PERCENT:
+      result.score = result.offPercent;
+      break;
+  }
+}
+
+template <typename Pow>
+PlanResult StitchPlanner::replanWith(const PlanResult &previous,
+                                     const std::vector<DirtyRect> &dirty,
+                                     const int numStarts,
+                                     const PlanScore score) const {
+
+  // nothing changed, or nothing to build on
+  if (dirty.empty()) return previous;
+  if (previous.tree.empty()) return planBest(numStarts, score);
+
+  const int numPoints = grid.size();
+
+  auto nearDirty = [&](const vec2 &p, const float pad) {
+    for (const DirtyRect &r : dirty)
+      if (r.near(p, pad)) return true;
+    return false;
+  };
+
+  // the previous plan only knows the points by position
+  std::unordered_map<vec2, int, HashVec> ids;
+
+  for (int i = 0; i < numPoints; ++i)
+    ids[grid.getPoint(i)] = i;
+
+  auto idOf = [&](const vec2 &p) {
+    auto it = ids.find(p);
+    return it == ids.end() ? -1 : it->second;
+  };
+
+  // the points whose stitches are planned again, found through the grid so
+  // the rest of the map is never looked at
+  std::vector<bool> open(numPoints, false);
+  std::vector<int> region, found;
+
+  for (const DirtyRect &r : dirty) {
+    const vec2 centre(0.5f * (r.x0 + r.x1), 0.5f * (r.y0 + r.y1));
+    const float reach = 0.5f * std::hypot(r.x1 - r.x0, r.y1 - r.y0) + REPLAN_MARGIN;
+
+    grid.query(centre, reach, found);
+
+    for (int i : found) {
+      if (!open[i] && r.near(grid.getPoint(i), REPLAN_MARGIN)) {
+        open[i] = true;
+        region.push_back(i);
+      }
+    }
+  }
+
+  // stitches of the previous plan clear of the edit stay as they are
+  std::vector<edge> kept;
+
+  for (const edge &e : previous.tree) {
+    const int u = idOf(e.u), v = idOf(e.v);
+
+    if (u != -1 && v != -1 && !open[u] && !open[v])
+      kept.push_back(e);
+  }
+
+  // the tree grows back into the region from the points around it
+  const float radius = 5.0f;
+
+  std::vector<char> isStart(numPoints, 0);
+  std::vector<int> starts;
+
+  for (int i : region) {
+    grid.query(grid.getPoint(i), radius, found);
+
+    for (int j : found) {
+      if (!open[j] && !isStart[j]) {
+        isStart[j] = 1;
+        starts.push_back(j);
+      }
+    }
+  }
+
+  PlanResult result;
+
+  // this run's own copy of the normal map, gets reversed along the way
+  Image *map = copyImage(normalMap);
+
+  const int width = map->getWidth();
+  const int height = map->getHeight();
+
+  // only the kept stitches that anything new could cross: new stitches
+  // reach 'radius' past the margin, repairs a little further
+  StitchGrid stitchGrid(vec2(0, 0), vec2(width, height), 5);
+
+  const float reach = REPLAN_MARGIN + 4 * radius;
+
+  for (const edge &e : kept) {
+    if (nearDirty(e.u, reach) || nearDirty(e.v, reach))
+      stitchGrid.add(e.u, e.v);
+  }
+
+  std::vector<edge> segments = this->segments;
+
+  DirectionCost<Pow> cost1(params.alpha1, params.beta1);
+  TurnCost<Pow> cost2(params.alpha2, params.beta2);
+
+  // the same stream whatever ran on this thread before
+  const uint64_t REPLAN_STREAM = 5ull << 32;
+
+  Xoshiro256 saved = threadRandom();
+  seedThreadRandom(REPLAN_STREAM);
+
+  std::vector<edge> local = map->dijkstra(starts, open, grid, stitchGrid,
+                                          normals, cost1, cost2, segments);
+
+  // cutting the region out may have split the previous tree, and points
+  // the search could not reach hang in the air, join the pieces up again
+  std::vector<edge> tree = kept;
+  tree.insert(tree.end(), local.begin(), local.end());
+
+  std::vector<int> around = region;
+  around.insert(around.end(), starts.begin(), starts.end());
+
+  std::vector<edge> joins = map->joinTrees(normals, tree, around, cost1, grid,
+                                           stitchGrid, 7.0f, segments);
+
+  local.insert(local.end(), joins.begin(), joins.end());
+  tree.insert(tree.end(), joins.begin(), joins.end());
+
+  // the dirty plan is the previous one around the edit
+  for (const edge &e : previous.spt) {
+    const int u = idOf(e.u), v = idOf(e.v);
+
+    if (u != -1 && v != -1 && !open[u] && !open[v])
+      result.spt.push_back(e);
+  }
+
+  result.spt.insert(result.spt.end(), local.begin(), local.end());
+
+  map->reverseNormalMap(result.spt, normals);
+
+  // only the new stitches can be jumps the previous plan did not fix
+  std::unordered_map<vec2, std::list<vec2>, HashVec> adj =
+    map->cleanup(normals, tree, local, cost1, grid, stitchGrid, segments);
+
+  // the path only walks the piece of the tree it starts in, if the joins
+  // left the points of the previous plan and the new ones in more than one
+  // piece the rest would be dropped, plan everything again then
+  std::vector<int> root(numPoints);
+  for (int i = 0; i < numPoints; ++i) root[i] = i;
+
+  for (auto &e : adj) {
+    const int u = idOf(e.first);
+
+    for (const vec2 &p : e.second) {
+      const int v = idOf(p);
+      if (u != -1 && v != -1) root[findRoot(root, u)] = findRoot(root, v);
+    }
+  }
+
+  int piece = -1;
+  bool split = false;
+
+  auto join = [&](const int i) {
+    if (i == -1) return;
+    const int r = findRoot(root, i);
+    if (piece == -1) piece = r;
+    else if (r != piece) split = true;
+  };
+
+  for (const edge &e : previous.tree) {
+    join(idOf(e.u));
+    join(idOf(e.v));
+  }
+
+  for (int i : region) join(i);
+
+  if (split) {
+    threadRandom() = saved;
+
+    map->destroy();
+    delete map;
+
+    return planBest(numStarts, score);
+  }
+
+  finish(map, adj, score, result);
+
+  threadRandom() = saved;
+
+  map->destroy();
+  delete map;
+
+  return result;
+}
+
+PlanResult StitchPlanner::replan(const PlanResult &previous,
+                                 const std::vector<DirtyRect> &dirty,
+                                 const int numStarts,
+                                 const PlanScore score) const {
+
+  if (params.cost == COST_TABLE)
+    return replanWith<TablePow>(previous, dirty, numStarts, score);
+
+  return replanWith<ExactPow>(previous, dirty, numStarts, score);
+}
+
+std::vector<DirtyRect> findDirtyRects(Image *before, Image *after,
+                                      const int tile) {
+
+  std::vector<DirtyRect> rects;
+
+  const int width = after->getWidth(), height = after->getHeight();
+
+  if (before->getWidth() != width || before->getHeight() != height) {
+    rects.push_back(DirtyRect(0, 0, width, height));
+    return rects;
+  }
+
+  const unsigned char *a = before->getPixmap();
+  const unsigned char *b = after->getPixmap();
+
+  const int cols = (width + tile - 1) / tile;
+  const int rows = (height + tile - 1) / tile;
+
+  // rects of the previous row of tiles, grown down while runs line up
+  std::vector<int> open, next;
+
+  for (int ty = 0; ty < rows; ++ty) {
+    const int y0 = ty * tile, y1 = std::min(y0 + tile, height);
+
+    next.clear();
+
+    for (int tx = 0; tx < cols; ) {
+      auto changed = [&](const int tx) {
+        const int x0 = tx * tile, x1 = std::min(x0 + tile, width);
+
+        for (int y = y0; y < y1; ++y) {
+          const size_t at = 4 * ((size_t)y * width + x0);
+
+          if (std::memcmp(a + at, b + at, 4 * (x1 - x0)) != 0) return true;
+        }
+        return false;
+      };
+
+      if (!changed(tx)) { ++tx; continue; }
+
+      int end = tx + 1;
+      while (end < cols && changed(end)) ++end;
+
+      const float x0 = tx * tile, x1 = std::min(end * tile, width);
+
+      // the same run as right above, make that rect taller
+      int r = -1;
+      for (int k : open)
+        if (rects[k].x0 == x0 && rects[k].x1 == x1) r = k;
+
+      if (r != -1)
+        rects[r].y1 = y1;
+      else {
+        r = rects.size();
+        rects.push_back(DirtyRect(x0, y0, x1, y1));
+      }
+
+      next.push_back(r);
+      tx = end;
+    }
+
+    open.swap(next);
+  }
+
+  return rects;
+}
+
+PlanResult StitchPlanner::planBest(const int numStarts, const PlanScore score,
+                                   int numThreads) const {
+
+  const int numPoints = grid.size();
+
+  if (numStarts <= 0 || numPoints == 0) return PlanResult();
+
+  // pick all the starts up front, from a stream of their own so they do not
+  // depend on what the calling thread drew before (PlanCache relies on it)
+  const uint64_t START_STREAM = 4ull << 32;
+
+  std::vector<int> starts(numStarts);
+  {
+    Xoshiro256 saved = threadRandom();
+    seedThreadRandom(START_STREAM);
+
+    for (int i = 0; i < numStarts; ++i)
+      starts[i] = genRand(0, numPoints - 1);
+
+    threadRandom() = saved;
+  }
+
+  if (numThreads <= 0)
+    numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  numThreads = std::min(numThreads, numStarts);
+
+  std::vector<PlanResult> results(numStarts);
+
+  // every worker keeps taking the next start until there are none left
+  std::atomic<int> next(0);
+
+  // run 'i' draws from stream PLAN_STREAM + i whatever thread it lands on,
+  // so the result only depends on the global seed
+  const uint64_t PLAN_STREAM = 1ull << 32;
+
+  auto worker = [&]() {
+    // leave the thread's own generator as it was
+    Xoshiro256 saved = threadRandom();
+
+    for (int i = next++; i < numStarts; i = next++) {
+      seedThreadRandom(PLAN_STREAM + i);
+      results[i] = plan(starts[i], score);
+    }
+
+    threadRandom() = saved;
+  };
+
+  // the calling thread is one of the workers
+  std::vector<std::thread> pool;
+
+  for (int t = 1; t < numThreads; ++t)
+    pool.push_back(std::thread(worker));
+
+  worker();
+
+  for (auto &t : pool)
+    t.join();
+
+  // lowest score wins, ties go to the earlier start
+  int best = 0;
+
+  for (int i = 1; i < numStarts; ++i) {
+    if (results[i].score < results[best].score)
+      best = i;
+  }
+
+  return results[best];
+}
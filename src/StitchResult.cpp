@@ -1,22 +1,17 @@
 #include "StitchResult.h"
 #include "Helpers.h"
+#include "StitchPlanner.h"
+#include "StitchExport.h"
+#include "QuadtreeSampler.h"
+#include "PlanCache.h"
+#include "Random.h"
 
 #include <fstream>
 #include <ostream>
-#include <sstream>
 #include <memory>
-#include <cstdio>
-#include <direct.h>
 
 int StitchResult::resultID = 0;
 
-// These were globals in the legacy stitch code, gotta carry it over the same way
-// to avoid a ton of unnecessary refactoring.
-float alpha1 = 1.4f;
-float alpha2 = 2.2f;
-float beta1 = 2.05f;
-float beta2 = 4.4f;
-
 StitchResult::StitchResult(int w, int h, int wn, int hn, PixelRGB**& normalMap, PixelRGB**& densityMap)
 {
     this->stitchImg = std::make_unique<Image>(w, h, 4);
@@ -79,36 +74,94 @@ StitchResult::~StitchResult()
     }
 }
 
-float cost1(vec2& u, vec2& v, vec2& n)
+StitchPlanState::~StitchPlanState()
+{
+    // Images don't free their pixels on their own.
+    if (densityMap != nullptr)
+        densityMap->destroy();
+
+    if (plannerMap != nullptr)
+        plannerMap->destroy();
+}
+
+bool StitchResult::PlanIncrementally(const PlanParams& params, Image* plannerMap, PointGrid& grid,
+    std::vector<unsigned char>& densityPoints, PlanResult& result)
 {
-    float distance = glm::length(v - u);
-    float cosangle = 0.0;
+    const StitchPlanState* last = previousPlan.get();
+
+    // Only after a stitch made the same way and from the same seed, so a new
+    // seed plans everything again, and only with the samplers that can place
+    // points in part of the map.
+    if (last == nullptr || last->plan.tree.empty() || last->sampler != pointSampler ||
+        last->score != planScore || last->numStarts != numStarts || last->seed != seed)
+        return false;
+
+    if (pointSampler != SAMPLER_GRID && pointSampler != SAMPLER_QUADTREE)
+        return false;
+
+    const int width = densityMapImg->getWidth();
+    const int height = densityMapImg->getHeight();
 
-    if (n.x != 0.0 || n.y != 0.0) {
-        vec2 e1 = glm::normalize(v - u);
-        vec2 e2 = glm::normalize(n);
-        cosangle = fabs(glm::dot(e1, e2));
+    // Tiles of a grid block, so a changed block gets all of its points again
+    // and no two rects share one.
+    std::vector<DirtyRect> densityDirty = findDirtyRects(last->densityMap.get(), densityMapImg.get(), subgridSize);
+    std::vector<DirtyRect> dirty = findDirtyRects(last->plannerMap.get(), plannerMap, subgridSize);
+    dirty.insert(dirty.end(), densityDirty.begin(), densityDirty.end());
+
+    float area = 0.0f;
+    for (const DirtyRect& r : dirty)
+        area += (r.x1 - r.x0) * (r.y1 - r.y0);
+
+    // Past about half the map, planning it all again is just as quick.
+    if (last->densityMap->getWidth() != width || last->densityMap->getHeight() != height ||
+        area > 0.5f * width * height)
+        return false;
+
+    std::vector<vec2> points;
+    std::vector<unsigned char> intensities;
+
+    // The points of the last stitch clear of the density edits...
+    for (int i = 0; i < last->grid.size(); i++)
+    {
+        const vec2& p = last->grid.getPoint(i);
+
+        bool inside = false;
+        for (const DirtyRect& r : densityDirty)
+            inside = inside || r.near(p);
+
+        if (!inside)
+        {
+            points.push_back(p);
+            intensities.push_back(last->densityPoints[i]);
+        }
     }
 
-    return -pow(alpha1, -distance) * pow(beta1, cosangle);
-};
+    // ...and fresh ones inside them.
+    seedThreadRandom(0);
 
-float cost2(vec2& u, vec2& v, vec2& w) {
+    QuadtreeSampler quadtreeSampler(densityMapImg.get(), quadtree);
 
-    // set both the control parameters as equal
-    // both length of the stitch and angle between stitches
-    // have an equal weight
-    float result = 0.0f;
+    for (const DirtyRect& r : densityDirty)
+    {
+        std::vector<vec2> fresh;
+
+        if (pointSampler == SAMPLER_QUADTREE)
+            fresh = quadtreeSampler.sample(intensities, r.x0, r.y0, r.x1, r.y1);
+        else
+            fresh = densityMapImg->genPoints(intensities, subgridSize,
+                (int)r.y0 / subgridSize, (int)r.x0 / subgridSize,
+                ((int)r.y1 + subgridSize - 1) / subgridSize, ((int)r.x1 + subgridSize - 1) / subgridSize);
+
+        points.insert(points.end(), fresh.begin(), fresh.end());
+    }
+
+    grid.build(points, StitchPlanner::SUBREGION_SIZE);
+    densityPoints.swap(intensities);
 
-    vec2 e1 = glm::normalize(u - v);
-    vec2 e2 = glm::normalize(w - v);
-    float cosangle = abs(glm::dot(e1, e2));
-    float distance = glm::length(w - v);
-    // float distance = abs(w.x - v.x) + abs(w.y - v.y);
+    StitchPlanner planner(plannerMap, grid, params);
+    result = planner.replan(last->plan, dirty, numStarts, planScore);
 
-    //result = -pow(alpha2, -distance) * beta1 * pow(beta2, -cosangle);
-    result = -pow(alpha2, -distance) * pow(beta2, -cosangle);
-    return result;
+    return true;
 }
 
 bool StitchResult::CreateStitches(bool createWindow)
@@ -127,55 +180,13 @@ bool StitchResult::CreateStitches(bool createWindow)
 
     // Beginning of legacy stitch generation, with a few modifications for compatibility
     // ---------
-    std::string dstName = fileName + ".csv";
-
-    // store the corresponding intensity values of the points
-    std::vector<unsigned char> densityPoints;
-
-    std::vector<vec2> points = densityMapImg->genPoints(densityPoints, subgridSize);
-
-    std::ofstream pdata("output/points.txt");
-
-    for (int i = 0; i < points.size(); ++i) {
-        vec2 point = points[i];
-        pdata << point.x << " " << point.y << "\n";
-    }
-
-    pdata.close();
-
-    // create a map for points and their corresponding densities
-    std::unordered_map<vec2, unsigned char, HashVec> densities;
-
-    // read in the no-gos
-    std::vector<edge> segments;
-
-    std::cout << "# of points = " << points.size() << "\n";
-
-    // place points in bins/buckets
-    std::unordered_map<vec2, std::vector<vec2>, HashVec> buckets;
-
-    const int SUBREGION_SIZE = 4;
-
-    // init the buckets, 10X10 100 buckets
-    for (size_t i = 0; i < normWidth / SUBREGION_SIZE; ++i)
-        for (size_t j = 0; j < normHeight / SUBREGION_SIZE; ++j)
-            buckets.insert({ vec2(i, j), {} });
-
-    // add points into their respective bins
-    for (size_t i = 0; i < points.size(); ++i) {
-
-        vec2 point = points[i];
-
-        // get bin co-ordinates
-        float x = std::floor(point.x / (float)SUBREGION_SIZE);
-        float y = std::floor(point.y / (float)SUBREGION_SIZE);
-
-        buckets[vec2(x, y)].push_back(point);
-    }
+    std::string dstName = "output/dst/" + fileName + ".dst";
 
+    // cost parameters of the runs, these used to be globals
+    PlanParams params;
 
     // target SCR
-    const float SCR = 0.0;
+    params.targetSCR = 0.0;
     float a1, b1, a2, b2;
     float w, scr;
     std::ifstream inparams("res/params/inter_params.txt");
@@ -186,13 +197,13 @@ bool StitchResult::CreateStitches(bool createWindow)
 
     while (inparams >> a1 >> b1 >> a2 >> b2 >> w >> scr) {
         // find right scr
-        if (SCR - 0.1 <= scr && scr <= SCR + 0.1) {
+        if (params.targetSCR - 0.1 <= scr && scr <= params.targetSCR + 0.1) {
             // check w
             if (fabs(w - scr) < diff) {
                 // update
                 diff = fabs(w - scr);
-                //alpha1 = a1; beta1 = b1;
-                //alpha2 = a2; beta2 = b2;
+                //params.alpha1 = a1; params.beta1 = b1;
+                //params.alpha2 = a2; params.beta2 = b2;
                 // update blend
                 bw = w;
             }
@@ -201,11 +212,9 @@ bool StitchResult::CreateStitches(bool createWindow)
 
     inparams.close();
 
-    std::cout << "a1 = " << alpha1 << ", b1 = " << beta1 << ", a2 = " << alpha2 << ", b2 = " << beta2 << "\n";
+    std::cout << "a1 = " << params.alpha1 << ", b1 = " << params.beta1 << ", a2 = " << params.alpha2 << ", b2 = " << params.beta2 << "\n";
     std::cout << "w = " << bw << "\n";
 
-    std::cout << "\nBuilding stitch....\n";
-
     // Temp copy of normal map that is later reversed in legacy code, so this
     // was required to make it work with new setup.
     std::unique_ptr<Image> reverseNormMap = std::make_unique<Image>(normWidth, normHeight, 4);
@@ -216,74 +225,113 @@ bool StitchResult::CreateStitches(bool createWindow)
         }
 
     bw = 0.0;
-    //beta2 = 5.0;
+    //params.beta2 = 5.0;
     reverseNormMap->blend(bw * 0.5 + 0.5);
 
-    std::vector<vec2> normals = reverseNormMap->interpretNormalMap();
+    std::cout << "\nBuilding stitch....\n";
 
-    // generate random start
-    const vec2 start = points[genRand(0, points.size() - 1)];
+    // store the corresponding intensity values of the points
+    std::vector<unsigned char> densityPoints;
+
+    // Everything below draws from generators derived from this seed, and the
+    // cache keys take it in, so other seeds never read back this stitch.
+    setRandomSeed(seed);
 
-    std::unordered_map<vec2, std::vector<edge>, HashVec> stitchBuckets;
+    // Points and plans of earlier runs, by a hash of their inputs. Making the
+    // same stitch again (say, only to save it under another name) reads them back.
+    // A rolled seed never comes up again, so its runs are neither looked up nor kept.
+    PlanCache cache("output/cache");
+    CacheKey pointsKey = pointsCacheKey(densityMapImg.get(), pointSampler, subgridSize, quadtree);
+    CacheKey planKey = planCacheKey(pointsKey, reverseNormMap.get(), params, numStarts, planScore);
 
-    // cost1 and cost 2 funcs. below are used in image->dijkstra(), which requires
-    // functions pointers not tied to any type to determine cost
-    std::vector<edge> g = reverseNormMap->dijkstra(start, buckets, stitchBuckets,
-        SUBREGION_SIZE,
-        normals, cost1, cost2,
-        segments);
+    PointGrid grid;
+    PlanResult best;
 
-    // write the dirty stitch plan to a file for a later render
-    std::ofstream ddata("output/dirty.txt");
+    bool havePoints = fixedSeed && cache.loadPoints(pointsKey, grid, densityPoints);
 
-    for (int i = 0; i < g.size(); ++i) {
-        edge e = g[i];
-        ddata << e.u.x << " " << e.u.y << " " << e.v.x << " " << e.v.y << "\n";
+    if (havePoints && cache.loadPlan(planKey, best))
+        std::cout << "Reusing the points and plan of an earlier stitch\n";
+    else if (PlanIncrementally(params, reverseNormMap.get(), grid, densityPoints, best))
+    {
+        // Freshly sampled points only cover the edits, so neither goes in the
+        // cache, where a full run would have made other ones.
+        std::cout << "Planned again only where the maps changed\n";
     }
+    else
+    {
+        if (havePoints)
+            std::cout << "Reusing the points of an earlier stitch\n";
+        else
+        {
+            std::vector<vec2> points;
+
+            // The grid sampler draws from this thread's generator, restart it so the
+            // points only depend on the seed, as the cache key assumes.
+            seedThreadRandom(0);
+
+            if (pointSampler == SAMPLER_POISSON)
+                points = PoissonSampler(densityMapImg.get()).sample(densityPoints);
+            else if (pointSampler == SAMPLER_CVT)
+            {
+                PoissonSampler poisson(densityMapImg.get());
+                points = poisson.sample(densityPoints);
+                poisson.relax(points, densityPoints);
+            }
+            else if (pointSampler == SAMPLER_QUADTREE)
+                points = QuadtreeSampler(densityMapImg.get(), quadtree).sample(densityPoints);
+            else
+                points = densityMapImg->genPoints(densityPoints, subgridSize);
 
-    ddata.close();
+            grid.build(points, StitchPlanner::SUBREGION_SIZE);
+            if (fixedSeed)
+                cache.storePoints(pointsKey, grid, densityPoints);
+        }
 
-    reverseNormMap->reverseNormalMap(g, normals);
+        // Every run gets its own copy of the normal map, so several starts can be
+        // planned in parallel and the best one kept.
+        StitchPlanner planner(reverseNormMap.get(), grid, params);
 
-    // fix jumps and get final graph
-    std::unordered_map<vec2, std::list<vec2>, HashVec> adj =
-        reverseNormMap->cleanup(normals, g, cost1,
-            buckets, stitchBuckets, SUBREGION_SIZE,
-            segments);
+        if (numStarts > 1)
+            std::cout << "Planning from " << numStarts << " starts...\n";
 
-    reverseNormMap->reverseNormalMap(adj, normals);
+        best = planner.planBest(numStarts, planScore);
+        if (fixedSeed)
+            cache.storePlan(planKey, best);
+    }
 
-    // tree traversal for path generation
-    std::vector<vec2> path;
-    reverseNormMap->genPath(adj, densities, path);
+    std::cout << "# of points = " << grid.size() << "\n";
 
-    std::vector<edge> graph;
-    // convert path to edges
-    for (int i = 0; i < path.size() - 2; ++i) {
+    // Kept for the next stitch to build on.
+    planState = std::make_shared<StitchPlanState>();
+    planState->densityMap = std::make_unique<Image>(densityMapImg->getWidth(), densityMapImg->getHeight(), 4);
+    planState->densityMap->copyImage(densityMapImg->getPixmap());
+    planState->plannerMap = std::move(reverseNormMap);
+    planState->grid = std::move(grid);
+    planState->densityPoints = std::move(densityPoints);
+    planState->plan = best;
+    planState->sampler = pointSampler;
+    planState->score = planScore;
+    planState->numStarts = numStarts;
+    planState->seed = seed;
 
-        graph.push_back(edge(path[i], path[i + 1]));
-    }
+    const std::vector<edge>& graph = best.graph;
 
     // print stitch count ratio
-    float rat = Image::SCR(g);
-    std::cout << "SCR = " << rat << "\n";
-
-    std::vector<bool> isoff;
-    reverseNormMap->flagOff(isoff, graph, normals);
+    std::cout << "SCR = " << best.scr << "\n";
+    std::cout << "RMS error = " << best.rmsError << "\n";
+    std::cout << "Off direction = " << best.offPercent << "%\n";
 
-    const float Height = 100;
-    const float Width = 100;
+    const float Height = densityMapImg->getHeight();
+    const float Width = densityMapImg->getWidth();
 
     float xr = imgWidth / Width;
     float yr = imgWidth / Height;
 
-    std::vector<pixel> v1 = reverseNormMap->readImageIntoBuffer();
-
-    std::vector<pixel> v2 = normalMapImg->readImageIntoBuffer();
-
-    pixel p = Image::RMSError(v2, v1);
-
-    std::ofstream data(dstName);
+    // Written straight from the stitches, no csv or external converter needed.
+    if (!writeStitchDST(dstName, graph, Width, Height, fileName, mmPerPixel))
+        std::cout << "Failed to save to: " << dstName << "\n";
+    else
+        std::cout << "Successfully saved to: " << dstName << "\n";
 
     if (createWindow)
     {
@@ -312,26 +360,6 @@ bool StitchResult::CreateStitches(bool createWindow)
         float x2 = graph[i].v.x;
         float y2 = Height - graph[i].v.y;
 
-        std::ostringstream s1;
-        s1 << Width - x1;
-        std::string sx1(s1.str());
-
-        std::ostringstream s2;
-        s2 << Height - y1;
-        std::string sy1(s2.str());
-
-        // On first iteration, jump to first stitch position. This is what removes the
-        // the "jump" stitch going across from a corner to a random stitch position.
-        if (i == 0)
-            data << "\"*\", \"JUMP\", " << "\"" << sx1 << "\", " << "\"" << sy1 << "\", " << "1\n";
-        if (i == graph.size() - 1)
-            data << "\"*\", \"END\", " << "\"" << sx1 << "\", " << "\"" << sy1 << "\", " << "0\n";
-        else {
-            if (isoff[i])
-                data << "\"*\", \"STITCH\", " << "\"" << sx1 << "\", " << "\"" << sy1 << "\", " << "1\n";
-            else
-                data << "\"*\", \"STITCH\", " << "\"" << sx1 << "\", " << "\"" << sy1 << "\", " << "0\n";
-        }
         // scale accord to the window size
         x1 *= xr; x2 *= xr;
         y1 *= yr; y2 *= yr;
@@ -341,8 +369,6 @@ bool StitchResult::CreateStitches(bool createWindow)
         //std::cout << imgWidth - x1 << " " << y1 << " " << imgWidth - x2 << " " << y2 << "\n";
     }
 
-    data.close();
-
     // Save what screen rendered to sitchImg now.
     SDL_Surface* surfaceTemp;
     Uint32 rmask, gmask, bmask, amask;
@@ -384,38 +410,6 @@ bool StitchResult::CreateStitches(bool createWindow)
             stitchImg->setpixel(y, x, pix);
         }
 
-    // run lib emb convert
-    char command[200];
-    std::string outputName = dstName.substr(0, dstName.find(".csv")) + ".dst";
-    std::cout << outputName << std::endl;
-
-    sprintf_s(command,
-        "libembroidery-convert.exe %s %s",
-        dstName.c_str(),
-        outputName.c_str());
-
-    // system call
-    // I don't like this, but for Windows there really is no easy way to do this
-    // in the same fashion as the legacy Linux stitching code. If speed/security
-    // becomes a problem in the future for converting the embroidery files, this
-    // needs to be changed !!
-    // - James
-    system(command);
-
-    if (std::rename(dstName.c_str(), ("output/csv/" + dstName).c_str()) != 0)
-    {
-        std::cout << "Failed to save to: " << ("output/csv/" + dstName + "\n");
-    }
-
-    if (std::rename(outputName.c_str(), ("output/dst/" + outputName).c_str()) != 0)
-    {
-        std::cout << "Failed to save to: " << ("output/dst/" + outputName + "\n");
-    }
-    else
-    {
-        std::cout << "Successfully saved to: " << ("output/dst/" + outputName + "\n");
-    }
-
     SDL_UpdateWindowSurface(window);
     SDL_RenderPresent(renderer);
 
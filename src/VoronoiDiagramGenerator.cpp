@@ -27,6 +27,9 @@
 * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
 */
 
+#include <algorithm>
+#include <utility>
+
 #include "VoronoiDiagramGenerator.h"
 
 VoronoiDiagramGenerator::VoronoiDiagramGenerator()
@@ -34,22 +37,68 @@ VoronoiDiagramGenerator::VoronoiDiagramGenerator()
 	siteidx = 0;
 	sites = 0;
 
-	allMemoryList = new FreeNodeArrayList;
-	allMemoryList->memory = 0;
-	allMemoryList->next = 0;
-	currentMemoryBlock = allMemoryList;
-	allEdges = 0;
+	poolBlock = 0;
+	poolUsed = 0;
+	hashScale = 1;
+	total_alloc = 0;
+
 	iteratorEdges = 0;
 	minDistanceBetweenSites = 0;
 }
 
 VoronoiDiagramGenerator::~VoronoiDiagramGenerator()
+{
+	releaseMemory();
+}
+
+void VoronoiDiagramGenerator::reserve(int numSites, float scale)
+{
+	hashScale = scale > 0 ? scale : 1;
+
+	if(numSites <= 0)
+		return;
+
+	// a diagram of n sites has at most 3n edges and 2n vertices, the
+	// halfedges and the hash tables come on top
+	int sn = (int)sqrt(numSites + 4.0);
+	size_t need = (size_t)numSites * (sizeof(Site) * 3 + sizeof(Edge) * 3 + sizeof(Halfedge) * 2)
+		+ (size_t)(sn * hashScale + 1) * (2 * sizeof(Halfedge*) + 4 * sizeof(Halfedge));
+
+	size_t have = 0;
+	for(size_t i = 0; i < poolSizes.size(); i++)
+		have += poolSizes[i];
+
+	if(need > have)
+		growPool(need - have);
+
+	allEdges.reserve(3 * numSites);
+	siteCoords.reserve(numSites);
+	delaunayEdges.reserve(6 * numSites);
+}
+
+void VoronoiDiagramGenerator::reset()
 {
 	cleanup();
 	cleanupEdges();
+	siteCoords.clear();
+	delaunayEdges.clear();
+}
+
+void VoronoiDiagramGenerator::releaseMemory()
+{
+	cleanup();
 
-	if(allMemoryList != 0)
-		delete allMemoryList;
+	for(size_t i = 0; i < poolBlocks.size(); i++)
+		free(poolBlocks[i]);
+
+	poolBlocks.clear();
+	poolSizes.clear();
+	total_alloc = 0;
+
+	std::vector<GraphEdge>().swap(allEdges);
+	std::vector<Point>().swap(siteCoords);
+	std::vector<int>().swap(delaunayEdges);
+	iteratorEdges = 0;
 }
 
 
@@ -79,8 +128,14 @@ bool VoronoiDiagramGenerator::generateVoronoi(float *xValues, float *yValues, in
 	xmax = xValues[0];
 	ymax = yValues[0];
 
+	siteCoords.resize(nsites);
+	delaunayEdges.clear();
+
 	for(i = 0; i< nsites; i++)
 	{
+		siteCoords[i].x = xValues[i];
+		siteCoords[i].y = yValues[i];
+
 		sites[i].coord.x = xValues[i];
 		sites[i].coord.y = yValues[i];
 		sites[i].sitenbr = i;
@@ -99,7 +154,7 @@ bool VoronoiDiagramGenerator::generateVoronoi(float *xValues, float *yValues, in
 		//printf("\n%f %f\n",xValues[i],yValues[i]);
 	}
 	
-	qsort(sites, nsites, sizeof (*sites), scomp);
+	std::sort(sites, sites + nsites, siteLess);
 	
 	siteidx = 0;
 	geominit();
@@ -131,7 +186,9 @@ bool VoronoiDiagramGenerator::ELinitialize()
 {
 	int i;
 	freeinit(&hfl, sizeof **ELhash);
-	ELhashsize = 2 * sqrt_nsites;
+	ELhashsize = (int)(2 * sqrt_nsites * hashScale);
+	if(ELhashsize < 2)
+		ELhashsize = 2;
 	ELhash = (struct Halfedge **) myalloc ( sizeof *ELhash * ELhashsize);
 
 	if(ELhash == 0)
@@ -555,7 +612,9 @@ bool VoronoiDiagramGenerator::PQinitialize()
 	
 	PQcount = 0;
 	PQmin = 0;
-	PQhashsize = 4 * sqrt_nsites;
+	PQhashsize = (int)(4 * sqrt_nsites * hashScale);
+	if(PQhashsize < 1)
+		PQhashsize = 1;
 	PQhash = (struct Halfedge *) myalloc(PQhashsize * sizeof *PQhash);
 
 	if(PQhash == 0)
@@ -584,11 +643,6 @@ char * VoronoiDiagramGenerator::getfree(struct Freelist *fl)
 
 		if(t == 0)
 			return 0;
-		
-		currentMemoryBlock->next = new FreeNodeArrayList;
-		currentMemoryBlock = currentMemoryBlock->next;
-		currentMemoryBlock->memory = t;
-		currentMemoryBlock->next = 0;
 
 		for(i=0; i<sqrt_nsites; i+=1) 	
 			makefree((struct Freenode *)((char *)t+i*fl->nodesize), fl);		
@@ -608,71 +662,76 @@ void VoronoiDiagramGenerator::makefree(struct Freenode *curr,struct Freelist *fl
 
 void VoronoiDiagramGenerator::cleanup()
 {
-	if(sites != 0)
-	{
-		free(sites);
-		sites = 0;
-	}
+	//everything of the sweep lives in the pool, rewinding it frees it all
+	//but keeps the blocks for the next diagram
+	sites = 0;
+	poolBlock = 0;
+	poolUsed = 0;
+}
 
-	FreeNodeArrayList* current=0, *prev = 0;
+void VoronoiDiagramGenerator::cleanupEdges()
+{
+	//keeps the capacity, so the next diagram does not allocate again
+	allEdges.clear();
+	iteratorEdges = 0;
+}
 
-	current = prev = allMemoryList;
+void VoronoiDiagramGenerator::pushGraphEdge(float x1, float y1, float x2, float y2, int site1, int site2)
+{
+	GraphEdge newEdge;
+	newEdge.x1 = x1;
+	newEdge.y1 = y1;
+	newEdge.x2 = x2;
+	newEdge.y2 = y2;
+	newEdge.site1 = site1;
+	newEdge.site2 = site2;
+	allEdges.push_back(newEdge);
+}
 
-	while(current->next != 0)
-	{
-		prev = current;
-		current = current->next;
-		free(prev->memory);
-		delete prev;
-		prev = 0;
-	}
 
-	if(current != 0 && current->memory != 0)
-	{
-		free(current->memory);
-		delete current;
-	}
+void VoronoiDiagramGenerator::growPool(size_t n)
+{
+	//at least double the pool, so a growing diagram needs few blocks
+	size_t size = 1 << 16;
+	if(!poolSizes.empty() && poolSizes.back() * 2 > size)
+		size = poolSizes.back() * 2;
+	if(n > size)
+		size = n;
+
+	char *t = (char*)malloc(size);
+	if(t == 0)
+		return;
 
-	allMemoryList = new FreeNodeArrayList;
-	allMemoryList->next = 0;
-	allMemoryList->memory = 0;
-	currentMemoryBlock = allMemoryList;
+	poolBlocks.push_back(t);
+	poolSizes.push_back(size);
+	total_alloc += size;
 }
 
-void VoronoiDiagramGenerator::cleanupEdges()
+char * VoronoiDiagramGenerator::myalloc(unsigned n)
 {
-	GraphEdge* geCurrent = 0, *gePrev = 0;
-	geCurrent = gePrev = allEdges;
+	//keep every node aligned for any of the sweep's structs
+	const size_t align = sizeof(double) > sizeof(void*) ? sizeof(double) : sizeof(void*);
+	size_t size = (n + align - 1) / align * align;
 
-	while(geCurrent != 0 && geCurrent->next != 0)
+	while(poolBlock < poolBlocks.size())
 	{
-		gePrev = geCurrent;
-		geCurrent = geCurrent->next;
-		delete gePrev;
-	}
-
-	allEdges = 0;
-
-}
+		if(poolUsed + size <= poolSizes[poolBlock])
+		{
+			char *t = poolBlocks[poolBlock] + poolUsed;
+			poolUsed += size;
+			return(t);
+		}
 
-void VoronoiDiagramGenerator::pushGraphEdge(float x1, float y1, float x2, float y2)
-{
-	GraphEdge* newEdge = new GraphEdge;
-	newEdge->next = allEdges;
-	allEdges = newEdge;
-	newEdge->x1 = x1;
-	newEdge->y1 = y1;
-	newEdge->x2 = x2;
-	newEdge->y2 = y2;
-}
+		poolBlock++;
+		poolUsed = 0;
+	}
 
+	growPool(size);
+	if(poolBlock >= poolBlocks.size())
+		return 0;
 
-char * VoronoiDiagramGenerator::myalloc(unsigned n)
-{
-	char *t=0;	
-	t=(char*)malloc(n);
-	total_alloc += n;
-	return(t);
+	poolUsed = size;
+	return(poolBlocks[poolBlock]);
 }
 
 
@@ -750,6 +809,10 @@ void VoronoiDiagramGenerator::clip_line(struct Edge *e)
 	y1 = e->reg[0]->coord.y;
 	y2 = e->reg[1]->coord.y;
 
+	//every bisector is a Delaunay edge, whether or not it survives clipping
+	delaunayEdges.push_back(e->reg[0]->sitenbr);
+	delaunayEdges.push_back(e->reg[1]->sitenbr);
+
 	//if the distance between the two points this line was created from is less than 
 	//the square root of 2, then ignore it
 	if(sqrt(((x2 - x1) * (x2 - x1)) + ((y2 - y1) * (y2 - y1))) < minDistanceBetweenSites)
@@ -848,8 +911,14 @@ void VoronoiDiagramGenerator::clip_line(struct Edge *e)
 		{	y2 = pymin; x2 = (e -> c - y2)/e -> a;};
 	};
 	
+	//an edge that lies entirely beyond the border along its main axis gets
+	//clamped onto the border as a single point, it is not part of the diagram
+	if(x1 == x2 && y1 == y2)
+		return;
+
 	//printf("\nPushing line (%f,%f,%f,%f)",x1,y1,x2,y2);
-	line(x1,y1,x2,y2);
+	//keep the sites on either side, so callers know whose cell the edge bounds
+	pushGraphEdge(x1,y1,x2,y2,e->reg[0]->sitenbr,e->reg[1]->sitenbr);
 }
 
 
@@ -1003,3 +1072,136 @@ struct Site * VoronoiDiagramGenerator::nextone()
 	else	
 		return( (struct Site *)NULL);
 }
+
+void VoronoiDiagramGenerator::getNeighbors(std::vector<int>& neighborStart, std::vector<int>& neighbors) const
+{
+	int n = (int)siteCoords.size();
+
+	neighborStart.assign(n + 1, 0);
+
+	//count, then fill
+	for(size_t i = 0; i < delaunayEdges.size(); i += 2)
+	{
+		neighborStart[delaunayEdges[i] + 1]++;
+		neighborStart[delaunayEdges[i + 1] + 1]++;
+	}
+
+	for(int i = 0; i < n; i++)
+		neighborStart[i + 1] += neighborStart[i];
+
+	neighbors.resize(neighborStart[n]);
+
+	std::vector<int> slot(neighborStart.begin(), neighborStart.end() - 1);
+
+	for(size_t i = 0; i < delaunayEdges.size(); i += 2)
+	{
+		neighbors[slot[delaunayEdges[i]]++] = delaunayEdges[i + 1];
+		neighbors[slot[delaunayEdges[i + 1]]++] = delaunayEdges[i];
+	}
+}
+
+void VoronoiDiagramGenerator::getCells(std::vector<int>& cellStart, std::vector<Point>& cellCorners) const
+{
+	int n = (int)siteCoords.size();
+
+	std::vector<int> neighborStart, neighbors;
+	getNeighbors(neighborStart, neighbors);
+
+	//ends of the clipped edges of every site
+	std::vector<int> endStart(n + 1, 0);
+
+	for(size_t i = 0; i < allEdges.size(); i++)
+	{
+		endStart[allEdges[i].site1 + 1] += 2;
+		endStart[allEdges[i].site2 + 1] += 2;
+	}
+
+	for(int i = 0; i < n; i++)
+		endStart[i + 1] += endStart[i];
+
+	std::vector<Point> ends(endStart[n]);
+	std::vector<int> slot(endStart.begin(), endStart.end() - 1);
+
+	for(size_t i = 0; i < allEdges.size(); i++)
+	{
+		const GraphEdge& edge = allEdges[i];
+		Point p1 = { edge.x1, edge.y1 };
+		Point p2 = { edge.x2, edge.y2 };
+
+		ends[slot[edge.site1]++] = p1;
+		ends[slot[edge.site1]++] = p2;
+		ends[slot[edge.site2]++] = p1;
+		ends[slot[edge.site2]++] = p2;
+	}
+
+	const Point box[4] = { { borderMinX, borderMinY }, { borderMaxX, borderMinY },
+	                       { borderMaxX, borderMaxY }, { borderMinX, borderMaxY } };
+
+	cellStart.assign(n + 1, 0);
+	cellCorners.clear();
+	cellCorners.reserve(ends.size() / 2 + 4);
+
+	//(angle around the site, corner)
+	std::vector<std::pair<float, Point> > corners;
+
+	for(int s = 0; s < n; s++)
+	{
+		const Point& site = siteCoords[s];
+		corners.clear();
+
+		for(int i = endStart[s]; i < endStart[s + 1]; i++)
+			corners.push_back(std::make_pair(0.0f, ends[i]));
+
+		//the box corners closer to this site than to any of its neighbors
+		for(int c = 0; c < 4; c++)
+		{
+			float dx = box[c].x - site.x, dy = box[c].y - site.y;
+			float d = dx * dx + dy * dy;
+			bool inside = true;
+
+			for(int i = neighborStart[s]; i < neighborStart[s + 1] && inside; i++)
+			{
+				const Point& other = siteCoords[neighbors[i]];
+				float ox = box[c].x - other.x, oy = box[c].y - other.y;
+				inside = d <= ox * ox + oy * oy;
+			}
+
+			if(inside)
+				corners.push_back(std::make_pair(0.0f, box[c]));
+		}
+
+		//a cell is convex and holds its site, so the angle around the site
+		//puts the corners in order
+		for(size_t i = 0; i < corners.size(); i++)
+			corners[i].first = atan2(corners[i].second.y - site.y, corners[i].second.x - site.x);
+
+		std::sort(corners.begin(), corners.end(),
+			[](const std::pair<float, Point>& a, const std::pair<float, Point>& b) { return a.first < b.first; });
+
+		//every corner is the end of two edges
+		for(size_t i = 0; i < corners.size(); i++)
+		{
+			const Point& p = corners[i].second;
+
+			if(cellCorners.size() > (size_t)cellStart[s])
+			{
+				const Point& last = cellCorners.back();
+				if(fabs(last.x - p.x) < 1e-4f && fabs(last.y - p.y) < 1e-4f)
+					continue;
+			}
+
+			cellCorners.push_back(p);
+		}
+
+		//the first and the last may be the same corner too
+		if(cellCorners.size() - cellStart[s] > 1)
+		{
+			const Point& first = cellCorners[cellStart[s]];
+			const Point& last = cellCorners.back();
+			if(fabs(last.x - first.x) < 1e-4f && fabs(last.y - first.y) < 1e-4f)
+				cellCorners.pop_back();
+		}
+
+		cellStart[s + 1] = (int)cellCorners.size();
+	}
+}
@@ -91,6 +91,25 @@ void VoronoiPoint::AddNode(const std::shared_ptr<IntersectionNode>& node)
 	}
 }
 
+void VoronoiPoint::AddNodes(const std::vector<std::shared_ptr<IntersectionNode>>& nodes)
+{
+	// Angle of every node computed once; a stable sort keeps nodes of equal angle
+	// in the order AddNode would leave them in.
+	std::vector<std::pair<float, std::shared_ptr<IntersectionNode>>> sorted;
+	sorted.reserve(neighboringNodes.size() + nodes.size());
+	for (auto& node : neighboringNodes)
+		sorted.emplace_back((float)(node->Get_Position() - position).Angle(), node);
+	for (auto& node : nodes)
+		sorted.emplace_back((float)(node->Get_Position() - position).Angle(), node);
+
+	std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<float, std::shared_ptr<IntersectionNode>>& a,
+		const std::pair<float, std::shared_ptr<IntersectionNode>>& b) { return a.first > b.first; });
+
+	neighboringNodes.clear();
+	for (auto& entry : sorted)
+		neighboringNodes.push_back(std::move(entry.second));
+}
+
 bool VoronoiPoint::RemoveNode(int nodeID)
 {
 	for (int i = 0; i < neighboringNodes.size(); i++)
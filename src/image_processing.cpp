@@ -9,6 +9,7 @@
 #include <iostream>
 #include "Image.h"
 #include "VoronoiDiagramGenerator.h"
+#include "CentroidalVoronoi.h"
 
 #include "utils.h"
 
@@ -920,27 +921,10 @@ void handleKey(unsigned char key, int x, int y) {
 
               cout << "# of points = " << points.size() << "\n";
 
-              // place points in bins/buckets
-              std::unordered_map<vec2, vector<vec2>, HashVec> buckets;
-
+              // place points in a bin lattice, points are referred to by their index
               const int SUBREGION_SIZE = 4;
 
-              // init the buckets, 10X10 100 buckets
-              for (size_t i = 0; i < width / SUBREGION_SIZE; ++i)
-                for (size_t j = 0; j < height / SUBREGION_SIZE; ++j)
-                  buckets.insert({vec2(i, j), {}});
-
-              // add points into their respective bins
-              for (size_t i = 0; i < points.size(); ++i) {
-
-                vec2 point = points[i];
-
-                // get bin co-ordinates
-                float x = std::floor(point.x / (float)SUBREGION_SIZE);
-                float y = std::floor(point.y / (float)SUBREGION_SIZE);
-
-                buckets[vec2(x, y)].push_back(point);
-              }
+              PointGrid grid(points, SUBREGION_SIZE);
 
               // target SCR
               const float SCR = 0.0;
@@ -982,13 +966,12 @@ void handleKey(unsigned char key, int x, int y) {
 
               // generate random start
 
-              const vec2 start = points[genRand(0, points.size() - 1)];
+              const int start = genRand(0, points.size() - 1);
               // const vec2 start = chooseStart(points, densityPoints);
 
-              std::unordered_map<vec2, vector<edge>, HashVec> stitchBuckets;
+              StitchGrid stitchGrid(vec2(0, 0), vec2(width, height), 5);
 
-              vector<edge> g = picture->dijkstra(start, buckets, stitchBuckets,
-                                                 SUBREGION_SIZE,
+              vector<edge> g = picture->dijkstra(start, grid, stitchGrid,
                                                  normals, cost1, cost,
                                                  segments);
 
@@ -1009,8 +992,7 @@ void handleKey(unsigned char key, int x, int y) {
               // fix jumps and get final graph
               std::unordered_map<vec2, std::list<vec2>, HashVec> adj =
               picture->cleanup(normals, g, cost1,
-                               buckets, stitchBuckets, SUBREGION_SIZE,
-                               segments);
+                               grid, stitchGrid, segments);
 
               picture->reverseNormalMap(adj, normals);
 
@@ -1140,7 +1122,22 @@ void handleKey(unsigned char key, int x, int y) {
                                 );
               }
 
-              // update points in loop
+              // relax to a density weighted CVT
+              // the window has y going up, the picture's rows go down
+              const int ph = picture->getHeight();
+              const int pw = picture->getWidth();
+
+              std::vector<float> density(pw * ph);
+
+              for (int h = 0; h < ph; ++h)
+                for (int w = 0; w < pw; ++w)
+                  density[(ph - 1 - h) * pw + w] =
+                    255.0 - float(picture->getpixel(h, w).r) + 100.0;
+
+              CVTParams cvt;
+              cvt.maxIterations = 100;
+              centroidalVoronoi(points, density, pw, ph, cvt);
+
             	size_t count = points.size();
 
               float* xValues = new float[count];
@@ -1151,121 +1148,6 @@ void handleKey(unsigned char key, int x, int y) {
                 yValues[i] = points[i].y;
               }
 
-              for (int iter = 0; iter < 100; ++iter) {
-
-                // magic!
-                VoronoiDiagramGenerator vdg;
-              	vdg.generateVoronoi(xValues, yValues, count, 0, wmax, 0, hmax, 0);
-
-                // compute edge list for every point
-              	vdg.resetIterator();
-
-                unordered_map<size_t, vector<vec2>> list;
-
-              	float x1, y1, x2, y2;
-                // make graph
-                while(vdg.getNext(x1, y1, x2, y2)) {
-                  // add edge
-                  pair<float, float> pu(x1, y1);
-                  pair<float, float> pv(x2, y2);
-
-                  if (pu == pv) continue;
-
-                  size_t u = 1000 * x1 + 100 * y1;
-                  size_t v = 1000 * x2 + 100 * y2;
-
-                  list[u].push_back(vec2(x2, y2));
-                  list[v].push_back(vec2(x1, y1));
-                }
-
-                // store voronoi vertices for all generators
-                unordered_map<size_t, vector<vec2>> voronois;
-                // (generator, voronoi vertex)
-
-                // store all voronoi vertices in a vector
-                vector<vec2> vertices;
-                unordered_set<size_t> pv;
-
-                vdg.resetIterator();
-
-                while(vdg.getNext(x1, y1, x2, y2)) {
-                  // compute hash
-                  size_t u = 1000 * x1 + 100 * y1;
-                  size_t v = 1000 * x2 + 100 * y2;
-
-                  if (pv.find(u) == pv.end()) {
-                    pv.insert(u);
-                    vertices.push_back(vec2(x1, y1));
-                  }
-
-                  if (pv.find(v) == pv.end()) {
-                    pv.insert(v);
-                    vertices.push_back(vec2(x2, y2));
-                  }
-
-                }
-
-                // process per vertex (voronoi vertex)
-                for (vec2 v : vertices) {
-
-                  // lookup degree for v
-                  size_t hv = 1000 * v.x + 100 * v.y;
-                  size_t d = list[hv].size();
-
-                  // get closest d number of points
-                  vector<vec2> closest;
-                  getClosestD(v, points, closest, d);
-                  // closest stores generators
-                  // write voronoi vertices for all selected generators
-                  for (int i = 0; i < closest.size(); ++i) {
-                    vec2 c = closest[i];
-                    // add voronoi vertex for each generator
-                    size_t cv = 1000 * c.x + 100 * c.y;
-                    voronois[cv].push_back(v);
-                  }
-                }
-
-                // finally, use weighted average to update points
-                for (int i = 0; i < points.size(); ++i) {
-                  // current point
-                  vec2 point = points[i];
-                  size_t hp = 1000 * point.x + 100 * point.y;
-
-                  vector<vec2> vors = voronois[hp];
-
-                  // new point
-                  vec2 up(0.0, 0.0);
-                  float totweight = 0.0;
-
-                  for (int s = 0; s < vors.size(); ++s) {
-                    // get weight for current point
-                    int h = max(0, int(99.0 - vors[s].y));
-                    h = min(99, h);
-                    int w = max(0, int(vors[s].x));
-                    w = min(99, w);
-
-                    float p = float(picture->getpixel(h, w).r);
-                    p = 255.0 - p + 100.0;
-
-                    if (vors[s].x < 0.0 || vors[s].x > 99.0) continue;
-                    if (vors[s].y < 0.0 || vors[s].y > 99.0) continue;
-
-                    up = up + vors[s];
-                    totweight += 1.0;
-                  }
-
-                  if (totweight > 0.0) {
-                    up = float(1.0 / totweight) * up;
-                    points[i] = up;
-                  }
-                }
-
-                for (int i = 0; i < count; ++i) {
-                  xValues[i] = points[i].x;
-                  yValues[i] = points[i].y;
-                }
-              }
-
             	printf("\n-------------------------------\n");
 
               const int Height = 100;
@@ -1,6 +1,6 @@
 #include "utils.h"
+#include "Random.h"
 
-#include <random>
 #include <algorithm>
 #include <queue>
 
@@ -9,30 +9,16 @@ using std::min;
 using std::pair;
 
 // return a random number between l and h
-// mersenne twister in action!!
+// drawn from this thread's generator, see Random.h
 int genRand(int l, int h) {
 
-	// obtain a random number from hardware
-	std::random_device rd;
-	// seed
-	std::mt19937 eng(rd());
-	// set the range
-	std::uniform_int_distribution<> distr(l, h);
-
-	return distr(eng);
+	return l + (int)randomBelow(h - l + 1);
 }
 
 // for doubles
 double genRand(double l, double h) {
 
-	// obtain a random number from hardware
-	std::random_device rd;
-	// seed
-	std::mt19937 eng(rd());
-	// set the range
-	std::uniform_real_distribution<> distr(l, h);
-
-	return distr(eng);
+	return l + randomUniform() * (h - l);
 }
 
 // Given three collinear points p, q, r, the function checks if
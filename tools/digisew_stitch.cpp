@@ -0,0 +1,267 @@
+// Headless stitch planner: normal map + density map in, embroidery file out.
+// Runs the same pipeline as the H key in the drawing program, without SDL
+// or any prompts, so it can be scripted over many map pairs.
+//
+// Ex. digisew_stitch normal_map1.png density_map_up.png 100 output/dst/out.dst
+//                    --starts 8 --score off
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+#include "Image.h"
+#include "StitchPlanner.h"
+#include "StitchExport.h"
+#include "Random.h"
+#include "PoissonSampler.h"
+#include "QuadtreeSampler.h"
+#include "PlanCache.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static void printUsage(const char* name)
+{
+    std::cout << "Usage: " << name << " <normal map> <density map> <resolution> <output .dst|.csv>\n"
+              << "       [--starts N] [--score scr|rms|off] [--cost exact|table]\n"
+              << "       [--threads N] [--seed N]\n"
+              << "       [--sampler grid|poisson|cvt|quadtree] [--spacing MM]\n"
+              << "       [--mm-per-pixel MM] [--cache DIR]\n\n"
+              << "  resolution  size of the square map the stitch is planned on,\n"
+              << "              a multiple of 10 (100 in the drawing program)\n"
+              << "  --starts    plan from N random starts, keep the best (default 1)\n"
+              << "  --score     what makes a plan the best (default scr)\n"
+              << "  --cost      how the cost models take their powers, with exp() or\n"
+              << "              from a precomputed table, faster but approximate (default exact)\n"
+              << "  --threads   threads to plan with, 0 = one per core (default 0)\n"
+              << "  --seed      random seed, the same seed gives the same stitches (default 0)\n"
+              << "  --sampler   how the stitch points are placed, a jittered grid per block\n"
+              << "              or poisson disk points following the density, cvt relaxes\n"
+              << "              those to a centroidal voronoi tessellation, quadtree cuts\n"
+              << "              the map by density and places points at a spacing in mm\n"
+              << "              (default grid)\n"
+              << "  --spacing   quadtree stitch spacing at the darkest density, in mm\n"
+              << "              (default " << QuadtreeParams().spacing << ")\n"
+              << "  --mm-per-pixel  size of a map pixel in the design, in mm, for the\n"
+              << "              quadtree spacing and the DST file (default 1)\n"
+              << "  --cache     keep the points and plans of runs in DIR, a run with the\n"
+              << "              same maps, parameters and seed reads them back (default off)\n";
+}
+
+/*
+ *  Loads an image file and resamples it (nearest pixel) into a
+ *  resolution x resolution Image. Returns nullptr if the file can't be read.
+ */
+static Image* LoadMap(const std::string& filename, int resolution)
+{
+    int width, height, bytes;
+    unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &bytes, 4);
+
+    if (pixels == nullptr)
+    {
+        std::cout << "Could not read " << filename << ": " << stbi_failure_reason() << "\n";
+        return nullptr;
+    }
+
+    Image* map = new Image(resolution, resolution, 4);
+
+    for (int h = 0; h < resolution; ++h)
+    {
+        int y = h * height / resolution;
+
+        for (int w = 0; w < resolution; ++w)
+        {
+            int x = w * width / resolution;
+            const unsigned char* p = pixels + 4 * (y * width + x);
+
+            map->setpixel(h, w, pixel(p[0], p[1], p[2], 255));
+        }
+    }
+
+    stbi_image_free(pixels);
+
+    return map;
+}
+
+int main(int args, char** argv)
+{
+    if (args < 5)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::string normalName = argv[1];
+    std::string densityName = argv[2];
+    int resolution = std::atoi(argv[3]);
+    std::string outputName = argv[4];
+
+    int numStarts = 1;
+    int numThreads = 0;
+    PlanScore score = SCORE_SCR;
+    PlanParams params;
+    PointSampler sampler = SAMPLER_GRID;
+    QuadtreeParams quadtree;
+    PlanCache cache;
+
+    for (int i = 5; i < args; ++i)
+    {
+        bool hasValue = i + 1 < args;
+
+        if (std::strcmp(argv[i], "--starts") == 0 && hasValue)
+            numStarts = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue)
+            numThreads = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--seed") == 0 && hasValue)
+            setRandomSeed(std::strtoull(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--spacing") == 0 && hasValue)
+            quadtree.spacing = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--mm-per-pixel") == 0 && hasValue)
+            quadtree.mmPerPixel = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--cache") == 0 && hasValue)
+            cache = PlanCache(argv[++i]);
+        else if (std::strcmp(argv[i], "--sampler") == 0 && hasValue)
+        {
+            if (!parsePointSampler(argv[++i], sampler))
+            {
+                std::cout << "Unknown sampler: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--cost") == 0 && hasValue)
+        {
+            if (!parsePlanCost(argv[++i], params.cost))
+            {
+                std::cout << "Unknown cost: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--score") == 0 && hasValue)
+        {
+            if (!parsePlanScore(argv[++i], score))
+            {
+                std::cout << "Unknown score: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    const int subgridSize = 10;
+
+    if (resolution < subgridSize || numStarts < 1 || !(quadtree.spacing > 0.0f) || !(quadtree.mmPerPixel > 0.0f))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Image* normalMap = LoadMap(normalName, resolution);
+    Image* densityMap = LoadMap(densityName, resolution);
+
+    if (normalMap == nullptr || densityMap == nullptr)
+        return 1;
+
+    // store the corresponding intensity values of the points
+    std::vector<unsigned char> densityPoints;
+    PointGrid grid;
+
+    CacheKey pointsKey = pointsCacheKey(densityMap, sampler, subgridSize, quadtree);
+
+    bool cachedPoints = cache.loadPoints(pointsKey, grid, densityPoints);
+
+    if (cachedPoints)
+        std::cout << "Points from the cache\n";
+    else if (sampler == SAMPLER_POISSON)
+    {
+        // straight into the planner's point grid
+        PoissonSampler poisson(densityMap);
+        poisson.sample(grid, StitchPlanner::SUBREGION_SIZE, densityPoints, numThreads);
+    }
+    else if (sampler == SAMPLER_CVT)
+    {
+        PoissonSampler poisson(densityMap);
+        std::vector<vec2> points = poisson.sample(densityPoints, numThreads);
+
+        CVTParams cvt;
+        cvt.numThreads = numThreads;
+
+        int iterations = poisson.relax(points, densityPoints, cvt);
+        std::cout << "CVT iterations = " << iterations << "\n";
+
+        grid.build(points, StitchPlanner::SUBREGION_SIZE);
+    }
+    else if (sampler == SAMPLER_QUADTREE)
+    {
+        QuadtreeSampler points(densityMap, quadtree);
+        points.sample(grid, StitchPlanner::SUBREGION_SIZE, densityPoints);
+    }
+    else
+        grid.build(densityMap->genPoints(densityPoints, subgridSize), StitchPlanner::SUBREGION_SIZE);
+
+    // sampled just now, keep them for the next run
+    if (!cachedPoints)
+        cache.storePoints(pointsKey, grid, densityPoints);
+
+    std::cout << "# of points = " << grid.size() << "\n";
+
+    // blue channel blend of the legacy pipeline
+    normalMap->blend(0.5);
+
+    PlanResult best;
+    CacheKey planKey = planCacheKey(pointsKey, normalMap, params, numStarts, score);
+
+    if (cache.loadPlan(planKey, best))
+        std::cout << "Plan from the cache\n";
+    else
+    {
+        StitchPlanner planner(normalMap, grid, params);
+        best = planner.planBest(numStarts, score, numThreads);
+
+        cache.storePlan(planKey, best);
+    }
+
+    std::cout << "start = " << best.start << "\n";
+    std::cout << "SCR = " << best.scr << "\n";
+    std::cout << "RMS error = " << best.rmsError << "\n";
+    std::cout << "Off direction = " << best.offPercent << "%\n";
+
+    // DST unless a libembroidery csv was asked for
+    bool written;
+    size_t dot = outputName.find_last_of('.');
+    std::string extension = (dot == std::string::npos) ? "" : outputName.substr(dot);
+
+    if (extension == ".csv")
+        written = writeStitchCSV(outputName, best.graph, best.isoff,
+                                 (float)resolution);
+    else
+    {
+        // label the design after the file name
+        size_t slash = outputName.find_last_of("/\\");
+        std::string label = outputName.substr(slash == std::string::npos ? 0 : slash + 1);
+        label = label.substr(0, label.find('.'));
+
+        written = writeStitchDST(outputName, best.graph,
+                                 (float)resolution, (float)resolution, label,
+                                 quadtree.mmPerPixel);
+    }
+
+    normalMap->destroy();
+    densityMap->destroy();
+    delete normalMap;
+    delete densityMap;
+
+    if (!written)
+    {
+        std::cout << "Failed to write: " << outputName << "\n";
+        return 1;
+    }
+
+    std::cout << "Saved to: " << outputName << "\n";
+
+    return 0;
+}